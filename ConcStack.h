@@ -0,0 +1,646 @@
+#ifndef CONCSTACK_H_INCLUDED
+#define CONCSTACK_H_INCLUDED
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+#include "Stack.h"
+
+//Lock-free concurrent stack (Treiber stack).
+//Nodes live in a pool of geometrically growing chunks that are freed only by stackDtor,
+//so a node read by a thread that lost the race is always valid memory. Head and free list
+//are 32-bit node index + 32-bit tag in one atomic word, tag changes on every CAS (no ABA).
+//Head and free list head are on separate cache lines, size is counted in per-thread shards
+//(see stackSize), so counting does not add one more contended line.
+//push/top/pop may be called from any thread. stackCtor/stackDtor/stackVerifyData/stackDump
+//need the stack to be quiescent (stackDump is memory safe, but may show a torn list otherwise).
+//Policy: canary protects struct and every node, hash adds per-node hash checked on pop,
+//poison fills elements of free nodes. Verify policy and struct hash are not used:
+//header changes on every op, stackCheck is always O(1)
+//
+//Elimination (policy elimination): push or pop that loses the CAS on head tries to meet an
+//opposite op in a random slot of the elimination array instead of retrying right away.
+//Number of slots in use grows when slots are found busy and shrinks when nobody shows up.
+
+const int    CONC_STACK_FIRST_CHUNK_LOG = 6;  //first chunk has 64 nodes, every next one twice as many
+const int    CONC_STACK_CHUNKS          = 26; //indices must fit in 32 bits
+const int    CONC_STACK_TOP_TRIES       = 100;
+const int    CONC_STACK_ELIM_SPINS      = 128; //how long a push waits in a slot for a pop
+const int    CONC_STACK_STAT_SHARDS     = 16; //shards of size and op counters
+const uint32_t CONC_STACK_DEAD          = UINT32_MAX;
+const uint32_t CONC_STACK_MAX_NODES     = (uint32_t)((1ull << (CONC_STACK_CHUNKS + CONC_STACK_FIRST_CHUNK_LOG))
+                                                   - (1ull << CONC_STACK_FIRST_CHUNK_LOG));
+
+template<typename elem_t, bool canary, bool hash>
+struct ConcStackNode{
+    [[no_unique_address]] StackField<canary, canary_t, 0> leftcan;
+    elem_t elem;
+    std::atomic<uint32_t> next;
+    [[no_unique_address]] StackField<hash  , hash_t  , 3> elem_hash;
+    [[no_unique_address]] StackField<canary, canary_t, 8> rightcan;
+};
+
+enum concStackSlotState_t{
+    CONC_SLOT_EMPTY   = 0,
+    CONC_SLOT_BUSY    = 1, //push is writing elem
+    CONC_SLOT_WAITING = 2, //push is waiting for a pop
+    CONC_SLOT_TAKING  = 3, //pop is reading elem
+    CONC_SLOT_TAKEN   = 4
+};
+
+template<typename elem_t>
+struct alignas(64) ConcStackElimSlot{
+    std::atomic<uint32_t> state;
+    elem_t elem;
+};
+
+//counters are sharded by thread, so counting does not add one more contended cache line.
+//size is pushes - pops of the threads that use the shard, only the sum over shards means anything
+struct alignas(64) ConcStackShard{
+    std::atomic<int64_t> size;
+    std::atomic<size_t>  pushes;     //stats only
+    std::atomic<size_t>  pops;       //stats only
+    std::atomic<size_t>  central;    //stats only
+    std::atomic<size_t>  eliminated; //stats only
+};
+
+struct ConcStackStats{
+    std::atomic<size_t> grows;
+};
+
+template<typename elem_t, class policy_t = StackPolicyFull, class traits_t = StackElemTraits<elem_t>>
+struct ConcStackT{
+    typedef elem_t   elem_type;
+    typedef policy_t policy_type;
+    typedef traits_t traits_type;
+
+    static constexpr bool   protect     = policy_t::protect;
+    static constexpr bool   canary      = protect && policy_t::canary;
+    static constexpr bool   hash        = protect && policy_t::hash;
+    static constexpr bool   poison      = protect && policy_t::poison;
+    static constexpr bool   stats       = policy_t::stats;
+    static constexpr bool   elimination = policy_t::elimination;
+    static constexpr size_t elimination_slots = policy_t::elimination_slots;
+
+    static_assert(!elimination || elimination_slots > 0, "elimination array has no slots");
+    static_assert(std::is_trivially_copyable_v<elem_t>, "elements are read by racing threads, use StackT for this type");
+
+    typedef ConcStackNode<elem_t, canary, hash> node_type;
+
+    [[no_unique_address]] StackField<canary , canary_t, 0> leftcan;
+
+    //every op CASes head and free_head, each gets its own line
+    alignas(64) std::atomic<uint64_t> head;      //tag << 32 | index of top node + 1, 0 = empty
+    alignas(64) std::atomic<uint64_t> free_head; //same for the list of free nodes
+    std::atomic<uint32_t>             allocated; //nodes taken from chunks, CONC_STACK_DEAD after stackDtor
+
+    ConcStackShard shards[CONC_STACK_STAT_SHARDS]; //size is their sum, see stackSize
+
+    alignas(64) std::atomic<node_type*> chunks[CONC_STACK_CHUNKS];
+    std::mutex              chunk_mutex;
+
+    [[no_unique_address]] StackField<protect, VarInfo            , 1> info;
+    [[no_unique_address]] StackField<stats  , ConcStackStats     , 9> stats_data;
+
+    [[no_unique_address]] StackField<elimination, ConcStackElimSlot<elem_t>[elimination_slots], 10> elim;
+    [[no_unique_address]] StackField<elimination, std::atomic<uint32_t>                        , 11> elim_range;
+
+    [[no_unique_address]] StackField<canary , canary_t, 8> rightcan;
+};
+
+#ifdef CONC_STACK_TEMPLATE
+    #error redefinition of internal macro CONC_STACK_TEMPLATE
+#endif
+#define CONC_STACK_TEMPLATE template<typename elem_t, class policy_t, class traits_t>
+#ifdef CONC_STACK_T
+    #error redefinition of internal macro CONC_STACK_T
+#endif
+#define CONC_STACK_T ConcStackT<elem_t, policy_t, traits_t>
+
+inline uint32_t concStackTagIndex(uint64_t tagged){
+    return (uint32_t)tagged;
+}
+inline uint64_t concStackTagNext(uint64_t tagged, uint32_t index){
+    return (((tagged >> 32) + 1) << 32) | index;
+}
+
+inline int concStackChunkOf(uint32_t index, size_t* offset){
+    uint64_t pos = (uint64_t)index - 1 + (1ull << CONC_STACK_FIRST_CHUNK_LOG);
+    int log = 63 - __builtin_clzll(pos);
+    *offset = pos - (1ull << log);
+    return log - CONC_STACK_FIRST_CHUNK_LOG;
+}
+
+//index is 1-based, node chunk must already be allocated
+CONC_STACK_TEMPLATE
+typename CONC_STACK_T::node_type* concStackNode(const CONC_STACK_T* stk, uint32_t index){
+    size_t offset = 0;
+    int chunk = concStackChunkOf(index, &offset);
+    return stk->chunks[chunk].load(std::memory_order_acquire) + offset;
+}
+
+CONC_STACK_TEMPLATE
+hash_t concStackNodeHash(const typename CONC_STACK_T::node_type* node){
+    return gnuHashFast(&(node->elem), &(node->elem) + 1);
+}
+
+CONC_STACK_TEMPLATE
+stackError_t concStackNodeError(const typename CONC_STACK_T::node_type* node){
+    unsigned int err = 0;
+    if constexpr (CONC_STACK_T::canary){
+        if (node->leftcan != CANARY_L)
+            err |= STACK_DATA_CANARY_L_BAD;
+        if (node->rightcan != CANARY_R)
+            err |= STACK_DATA_CANARY_R_BAD;
+    }
+    if constexpr (CONC_STACK_T::hash){
+        if (node->elem_hash != concStackNodeHash<elem_t, policy_t, traits_t>(node))
+            err |= STACK_DATA_HASH_BAD;
+    }
+    return (stackError_t)err;
+}
+
+//returns 0 if pool is exhausted
+CONC_STACK_TEMPLATE
+uint32_t concStackAllocNode(CONC_STACK_T* stk){
+    uint64_t old = stk->free_head.load(std::memory_order_acquire);
+    while (concStackTagIndex(old) != 0){
+        uint32_t next = concStackNode(stk, concStackTagIndex(old))->next.load(std::memory_order_relaxed);
+        if (stk->free_head.compare_exchange_weak(old, concStackTagNext(old, next), std::memory_order_acquire))
+            return concStackTagIndex(old);
+    }
+
+    //chunk of the next index is allocated before the index is claimed, so a failed calloc loses no index
+    uint32_t allocated = stk->allocated.load(std::memory_order_relaxed);
+    while (true){
+        if (allocated >= CONC_STACK_MAX_NODES)
+            return 0;
+        uint32_t index = allocated + 1;
+
+        size_t offset = 0;
+        int chunk = concStackChunkOf(index, &offset);
+        if (stk->chunks[chunk].load(std::memory_order_acquire) == nullptr){
+            std::lock_guard<std::mutex> lock(stk->chunk_mutex);
+            if (stk->chunks[chunk].load(std::memory_order_relaxed) == nullptr){
+                size_t nodes = 1ull << (chunk + CONC_STACK_FIRST_CHUNK_LOG);
+                typename CONC_STACK_T::node_type* mem = (typename CONC_STACK_T::node_type*)calloc(nodes, sizeof(*mem));
+                if (mem == nullptr){
+                    perror_log("error while allocating nodes for concurrent stack");
+                    return 0;
+                }
+                stk->chunks[chunk].store(mem, std::memory_order_release);
+                if constexpr (CONC_STACK_T::stats)
+                    stk->stats_data.grows.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (stk->allocated.compare_exchange_weak(allocated, index, std::memory_order_relaxed))
+            return index;
+    }
+}
+
+CONC_STACK_TEMPLATE
+void concStackFreeNode(CONC_STACK_T* stk, uint32_t index){
+    typename CONC_STACK_T::node_type* node = concStackNode(stk, index);
+    if constexpr (CONC_STACK_T::poison)
+        node->elem = traits_t::poison();
+
+    uint64_t old = stk->free_head.load(std::memory_order_relaxed);
+    do{
+        node->next.store(concStackTagIndex(old), std::memory_order_relaxed);
+    } while (!stk->free_head.compare_exchange_weak(old, concStackTagNext(old, index), std::memory_order_release,
+                                                                                      std::memory_order_relaxed));
+}
+
+//per-thread xorshift, used for slot choice and stat shards
+inline uint32_t concStackThreadRand(){
+    static thread_local uint32_t state = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+inline int concStackThreadShard(){
+    static thread_local int shard = concStackThreadRand() % CONC_STACK_STAT_SHARDS;
+    return shard;
+}
+
+//eliminated ops do not change size
+CONC_STACK_TEMPLATE
+void concStackCountOp(CONC_STACK_T* stk, bool push, bool eliminated){
+    ConcStackShard* shard = &(stk->shards[concStackThreadShard()]);
+    if (!eliminated)
+        shard->size.fetch_add(push? 1 : -1, std::memory_order_relaxed);
+    if constexpr (CONC_STACK_T::stats){
+        (push      ? shard->pushes     : shard->pops   ).fetch_add(1, std::memory_order_relaxed);
+        (eliminated? shard->eliminated : shard->central).fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//exact when quiescent, otherwise may even be off by more than the ops in flight
+CONC_STACK_TEMPLATE
+size_t stackSize(const CONC_STACK_T* stk){
+    int64_t size = 0;
+    for (int i = 0; i < CONC_STACK_STAT_SHARDS; i++)
+        size += stk->shards[i].size.load(std::memory_order_relaxed);
+    return (size > 0)? (size_t)size : 0;
+}
+
+//busy slot: more threads collide than there are slots in use
+CONC_STACK_TEMPLATE
+void concStackElimGrow(CONC_STACK_T* stk){
+    uint32_t range = stk->elim_range.load(std::memory_order_relaxed);
+    if (range < CONC_STACK_T::elimination_slots)
+        stk->elim_range.compare_exchange_weak(range, range + 1, std::memory_order_relaxed);
+}
+//nobody came: slots in use are too many to meet in
+CONC_STACK_TEMPLATE
+void concStackElimShrink(CONC_STACK_T* stk){
+    uint32_t range = stk->elim_range.load(std::memory_order_relaxed);
+    if (range > 1)
+        stk->elim_range.compare_exchange_weak(range, range - 1, std::memory_order_relaxed);
+}
+
+CONC_STACK_TEMPLATE
+ConcStackElimSlot<elem_t>* concStackElimSlot(CONC_STACK_T* stk){
+    return &(stk->elim[concStackThreadRand() % stk->elim_range.load(std::memory_order_relaxed)]);
+}
+
+//offers elem to a pop, returns true if it was taken
+CONC_STACK_TEMPLATE
+bool concStackElimPush(CONC_STACK_T* stk, const elem_t& elem){
+    ConcStackElimSlot<elem_t>* slot = concStackElimSlot(stk);
+
+    uint32_t state = CONC_SLOT_EMPTY;
+    if (!slot->state.compare_exchange_strong(state, CONC_SLOT_BUSY, std::memory_order_acquire)){
+        concStackElimGrow(stk);
+        return false;
+    }
+    slot->elem = elem;
+    slot->state.store(CONC_SLOT_WAITING, std::memory_order_release);
+
+    for (int i = 0; i < CONC_STACK_ELIM_SPINS; i++){
+        if (slot->state.load(std::memory_order_acquire) == CONC_SLOT_TAKEN){
+            slot->state.store(CONC_SLOT_EMPTY, std::memory_order_release);
+            return true;
+        }
+    }
+
+    state = CONC_SLOT_WAITING;
+    if (slot->state.compare_exchange_strong(state, CONC_SLOT_EMPTY, std::memory_order_relaxed)){
+        concStackElimShrink(stk);
+        return false;
+    }
+    //a pop got here first, wait until it reads elem
+    while (slot->state.load(std::memory_order_acquire) != CONC_SLOT_TAKEN)
+        std::this_thread::yield();
+    slot->state.store(CONC_SLOT_EMPTY, std::memory_order_release);
+    return true;
+}
+
+//takes elem offered by a push, returns true on success
+CONC_STACK_TEMPLATE
+bool concStackElimPop(CONC_STACK_T* stk, elem_t* elem){
+    ConcStackElimSlot<elem_t>* slot = concStackElimSlot(stk);
+
+    uint32_t state = CONC_SLOT_WAITING;
+    if (!slot->state.compare_exchange_strong(state, CONC_SLOT_TAKING, std::memory_order_acquire)){
+        if (state == CONC_SLOT_EMPTY)
+            concStackElimShrink(stk);
+        else
+            concStackElimGrow(stk);
+        return false;
+    }
+    *elem = slot->elem;
+    slot->state.store(CONC_SLOT_TAKEN, std::memory_order_release);
+    return true;
+}
+
+CONC_STACK_TEMPLATE
+bool stackCtor_(CONC_STACK_T* stk, VarInfo info){
+    if constexpr (CONC_STACK_T::protect){
+        if (isBadWritePtr(stk, sizeof(*stk))){
+            return false;
+        }
+    }
+    stk->head.store(0);
+    stk->free_head.store(0);
+    stk->allocated.store(0);
+    for (int i = 0; i < CONC_STACK_CHUNKS; i++)
+        stk->chunks[i].store(nullptr);
+    for (int i = 0; i < CONC_STACK_STAT_SHARDS; i++){
+        stk->shards[i].size      .store(0);
+        stk->shards[i].pushes    .store(0);
+        stk->shards[i].pops      .store(0);
+        stk->shards[i].central   .store(0);
+        stk->shards[i].eliminated.store(0);
+    }
+
+    if constexpr (CONC_STACK_T::stats)
+        stk->stats_data.grows.store(0);
+    if constexpr (CONC_STACK_T::elimination){
+        for (size_t i = 0; i < CONC_STACK_T::elimination_slots; i++)
+            stk->elim[i].state.store(CONC_SLOT_EMPTY);
+        stk->elim_range.store(1);
+    }
+    if constexpr (CONC_STACK_T::protect){
+        ptrTrack(stk, sizeof(*stk));
+        stk->info = info;
+    }
+    if constexpr (CONC_STACK_T::canary){
+        stk->leftcan  = CANARY_L;
+        stk->rightcan = CANARY_R;
+    }
+    return true;
+}
+
+CONC_STACK_TEMPLATE
+stackError_t stackError(const CONC_STACK_T* stk){
+    if (stk == nullptr)
+        return STACK_NULL;
+
+    if constexpr (CONC_STACK_T::protect){
+        if (isBadReadPtr(stk, sizeof(*stk)))
+            return STACK_BAD;
+    }
+
+    //indices are loaded before allocated, which only grows until stackDtor marks it dead
+    uint32_t head      = concStackTagIndex(stk->head     .load(std::memory_order_acquire));
+    uint32_t free_head = concStackTagIndex(stk->free_head.load(std::memory_order_acquire));
+    uint32_t allocated = stk->allocated.load(std::memory_order_relaxed);
+    if (allocated == CONC_STACK_DEAD)
+        return STACK_DEAD;
+
+    unsigned int err = 0;
+    if constexpr (CONC_STACK_T::canary){
+        if (stk->leftcan != CANARY_L)
+            err |= STACK_CANARY_L_BAD;
+        if (stk->rightcan != CANARY_R)
+            err |= STACK_CANARY_R_BAD;
+    }
+
+    if (head > allocated || free_head > allocated)
+        err |= STACK_DATA_BAD;
+
+    return (stackError_t)err;
+}
+
+//checks every node in the list, stack must be quiescent
+CONC_STACK_TEMPLATE
+stackError_t stackVerifyData(const CONC_STACK_T* stk){
+    int err = stackError(stk);
+    if (err)
+        return (stackError_t)err;
+
+    size_t   size  = stackSize(stk);
+    size_t   count = 0;
+    uint32_t index = concStackTagIndex(stk->head.load(std::memory_order_acquire));
+    while (index != 0){
+        if (index > stk->allocated.load(std::memory_order_relaxed) || count >= size){
+            err |= STACK_DATA_BAD;
+            break;
+        }
+        const typename CONC_STACK_T::node_type* node = concStackNode(stk, index);
+        err |= concStackNodeError<elem_t, policy_t, traits_t>(node);
+        index = node->next.load(std::memory_order_relaxed);
+        count++;
+    }
+    if (count != size)
+        err |= STACK_SIZE_CAP_BAD;
+    return (stackError_t)err;
+}
+
+CONC_STACK_TEMPLATE
+inline stackError_t stackCheck(CONC_STACK_T* stk){
+    if constexpr (CONC_STACK_T::protect)
+        return stackError(stk);
+    else
+        return STACK_NOERROR;
+}
+
+CONC_STACK_TEMPLATE
+inline stackError_t stackError_dbg(CONC_STACK_T* stk){
+    return stackCheck(stk);
+}
+
+CONC_STACK_TEMPLATE
+void stackDump(const CONC_STACK_T* stk){
+    if (!LOG_ENABLED(LOG_LEVEL_INFO))
+        return;
+
+    info_log("Concurrent stack dump:\n      stack at %p \n", stk);
+
+    stackError_t err = stackError(stk);
+    if (err & STACK_NULL){
+        printf_log("      (BAD)  Stack poiner is null\n");
+        return;
+    }
+    if (err & STACK_BAD){
+        printf_log("      (BAD)  Stack poiner is invalid\n");
+        return;
+    }
+    if (err & STACK_DEAD){
+        printf_log("      (BAD)  Stack was already destructed\n\n");
+        return;
+    }
+
+    size_t size = stackSize(stk);
+    printf_log("      %ld elements, %u nodes allocated\n", size, stk->allocated.load());
+
+    if constexpr (CONC_STACK_T::protect)
+        printVarInfo_log(&(stk->info));
+
+    if constexpr (CONC_STACK_T::canary){
+        if (err & STACK_CANARY_L_BAD){
+            printf_log("      (BAD)  Struct L canary BAD! Value: %p\n", stk->leftcan);
+        }
+        if (err & STACK_CANARY_R_BAD){
+            printf_log("      (BAD)  Struct R canary BAD! Value: %p\n", stk->rightcan);
+        }
+    }
+    if (err & STACK_DATA_BAD){
+        printf_log("      (BAD)  Head index is out of node pool\n\n");
+        return;
+    }
+    printf_log("\n");
+
+    uint32_t allocated = stk->allocated.load();
+    uint32_t index     = concStackTagIndex(stk->head.load());
+    for (size_t i = 0; index != 0 && i < size; i++){
+        if (index > allocated){
+            printf_log("      (BAD)  Node index %u is out of node pool\n", index);
+            break;
+        }
+        const typename CONC_STACK_T::node_type* node = concStackNode(stk, index);
+        printf_log("    *[%ld] ", i);
+        traits_t::print(node->elem);
+
+        stackError_t node_err = concStackNodeError<elem_t, policy_t, traits_t>(node);
+        if (node_err & STACK_DATA_CANARY_L_BAD) printf_log(" (BAD L canary)");
+        if (node_err & STACK_DATA_CANARY_R_BAD) printf_log(" (BAD R canary)");
+        if (node_err & STACK_DATA_HASH_BAD)     printf_log(" (BAD hash)");
+        printf_log("%s", (traits_t::isPoison(node->elem)) ? " (POISON)\n":" \n");
+
+        index = node->next.load(std::memory_order_relaxed);
+    }
+    printf_log("\n");
+}
+
+CONC_STACK_TEMPLATE
+stackError_t stackDtor(CONC_STACK_T* stk){
+    stackCheckRet(stk);
+
+    for (int i = 0; i < CONC_STACK_CHUNKS; i++){
+        typename CONC_STACK_T::node_type* chunk = stk->chunks[i].load();
+        if (chunk == nullptr)
+            continue;
+        if constexpr (CONC_STACK_T::poison){
+            size_t nodes = 1ull << (i + CONC_STACK_FIRST_CHUNK_LOG);
+            for (size_t j = 0; j < nodes; j++)
+                chunk[j].elem = traits_t::poison();
+        }
+        free(chunk);
+        stk->chunks[i].store(nullptr);
+    }
+
+    stk->head.store(0);
+    stk->free_head.store(0);
+    stk->allocated.store(CONC_STACK_DEAD);
+    if constexpr (CONC_STACK_T::protect){
+        ptrUntrack(stk);
+        (stk->info).status = VARSTATUS_DEAD;
+    }
+    return STACK_NOERROR;
+}
+
+CONC_STACK_TEMPLATE
+stackError_t stackPush(CONC_STACK_T* stk, typename CONC_STACK_T::elem_type elem){
+    stackCheckRet(stk);
+
+    uint32_t index = concStackAllocNode(stk);
+    if (index == 0){
+        error_log("%s", "concurrent stack node pool exhausted\n");
+        return STACK_OP_ERROR;
+    }
+
+    typename CONC_STACK_T::node_type* node = concStackNode(stk, index);
+    node->elem = elem;
+    if constexpr (CONC_STACK_T::canary){
+        node->leftcan  = CANARY_L;
+        node->rightcan = CANARY_R;
+    }
+    if constexpr (CONC_STACK_T::hash)
+        node->elem_hash = concStackNodeHash<elem_t, policy_t, traits_t>(node);
+
+    uint64_t old = stk->head.load(std::memory_order_relaxed);
+    while (true){
+        node->next.store(concStackTagIndex(old), std::memory_order_relaxed);
+        if (stk->head.compare_exchange_weak(old, concStackTagNext(old, index), std::memory_order_release,
+                                                                               std::memory_order_relaxed))
+            break;
+
+        if constexpr (CONC_STACK_T::elimination){
+            if (concStackElimPush(stk, elem)){
+                concStackFreeNode(stk, index);
+                concStackCountOp(stk, true, true);
+                return STACK_NOERROR;
+            }
+            old = stk->head.load(std::memory_order_relaxed);
+        }
+    }
+    concStackCountOp(stk, true, false);
+    return STACK_NOERROR;
+}
+
+//value may be popped by another thread right after it is returned
+CONC_STACK_TEMPLATE
+elem_t stackTop(CONC_STACK_T* stk, stackError_t *err_ptr = nullptr){
+    stackCheckRetPtr(stk, err_ptr, traits_t::poison());
+
+    for (int i = 0; i < CONC_STACK_TOP_TRIES; i++){
+        uint64_t old = stk->head.load(std::memory_order_acquire);
+        if (concStackTagIndex(old) == 0){
+            if (err_ptr)
+                *err_ptr = STACK_OP_INVALID;
+            return traits_t::poison();
+        }
+        elem_t ret = concStackNode(stk, concStackTagIndex(old))->elem;
+
+        //node could have been popped and reused while elem was copied
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (stk->head.load(std::memory_order_relaxed) == old)
+            return ret;
+    }
+    if (err_ptr)
+        *err_ptr = STACK_OP_ERROR;
+    return traits_t::poison();
+}
+
+CONC_STACK_TEMPLATE
+elem_t stackPop(CONC_STACK_T* stk, stackError_t *err_ptr = nullptr){
+    stackCheckRetPtr(stk, err_ptr, traits_t::poison());
+
+    uint64_t old = stk->head.load(std::memory_order_acquire);
+    typename CONC_STACK_T::node_type* node = nullptr;
+    while (true){
+        if (concStackTagIndex(old) == 0){
+            if (err_ptr)
+                *err_ptr = STACK_OP_INVALID;
+            return traits_t::poison();
+        }
+        node = concStackNode(stk, concStackTagIndex(old));
+        if (stk->head.compare_exchange_weak(old, concStackTagNext(old, node->next.load(std::memory_order_relaxed)),
+                                            std::memory_order_acquire))
+            break;
+
+        if constexpr (CONC_STACK_T::elimination){
+            elem_t ret = {};
+            if (concStackElimPop(stk, &ret)){
+                concStackCountOp(stk, false, true);
+                return ret;
+            }
+            old = stk->head.load(std::memory_order_acquire);
+        }
+    }
+    concStackCountOp(stk, false, false);
+
+    //node is owned by this thread until it is freed
+    stackError_t err = concStackNodeError<elem_t, policy_t, traits_t>(node);
+    elem_t ret = node->elem;
+    concStackFreeNode(stk, concStackTagIndex(old));
+
+    if (err){
+        error_log("Concurrent stack %p: popped node %u is corrupted, error %x\n", stk, concStackTagIndex(old), err);
+        if (err_ptr)
+            *err_ptr = err;
+        return traits_t::poison();
+    }
+    return ret;
+}
+
+//high_water is nodes ever taken from the pool: largest size plus pushes in flight at that moment
+CONC_STACK_TEMPLATE
+stackError_t stackGetStats(const CONC_STACK_T* stk, StackStats* stats){
+    if (stk == nullptr || stats == nullptr)
+        return STACK_NULL;
+    *stats = {};
+    if constexpr (CONC_STACK_T::stats){
+        uint32_t allocated = stk->allocated.load(std::memory_order_relaxed);
+        stats->high_water = (allocated != CONC_STACK_DEAD)? allocated : 0;
+        stats->grows      = stk->stats_data.grows.load(std::memory_order_relaxed);
+        for (int i = 0; i < CONC_STACK_STAT_SHARDS; i++){
+            stats->pushes     += stk->shards[i].pushes    .load(std::memory_order_relaxed);
+            stats->pops       += stk->shards[i].pops      .load(std::memory_order_relaxed);
+            stats->central    += stk->shards[i].central   .load(std::memory_order_relaxed);
+            stats->eliminated += stk->shards[i].eliminated.load(std::memory_order_relaxed);
+        }
+        return STACK_NOERROR;
+    }
+    else{
+        return STACK_OP_INVALID;
+    }
+}
+
+#endif // CONCSTACK_H_INCLUDED
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+
+#include "Console_utils.h"
+
+void createProgressBar(FILE* out, int total, int filled, const char* bar_string, consoleColor color_full, consoleColor color_empty){
+    assert(strlen(bar_string) >= 5);
+    fputc(bar_string[0], out);
+    if (!(color_full & COLOR_NOCHANGE)){
+        fflush(out);
+        setConsoleColor(out, color_full, COLOR_BLACK);
+    }
+    for (int x = 0; x < filled; x++)
+        fputc(bar_string[1], out);
+    if (!(color_empty & COLOR_NOCHANGE)){
+        fflush(out);
+        setConsoleColor(out, color_empty, COLOR_BLACK);
+    }
+
+
+    if (filled != total)
+        fputc(bar_string[2], out);
+    for (int x = filled+1; x < total; x++)
+        fputc(bar_string[3], out);
+
+    fputc(bar_string[4], out);
+    fflush(out);
+}
+void createNormalProgressBar(FILE* out, int total, int filled){
+    createProgressBar(out, total, filled, "[=  ]", COLOR_GREEN, COLOR_DEFAULTT);
+}
+
+void createSimpleProgressBar(FILE* out, int total, int filled){
+    createProgressBar(out, total, filled, "[=  ]", COLOR_NOCHANGE, COLOR_NOCHANGE);
+}
+
@@ -1,6 +1,12 @@
 #ifndef CONSOLE_UTILS_H_INCLUDED
 #define CONSOLE_UTILS_H_INCLUDED
 
+#include <stdio.h>
+
+//Backends: Console_utils_win.cpp (console API) and Console_utils_posix.cpp (ANSI escapes,
+//only when the stream is a terminal), each compiles to nothing on the other platform.
+//Progress bars are built on top of them in Console_utils.cpp
+
 enum consoleColor {
     COLOR_BLACK   = 0b000,
     COLOR_RED     = 0b100,
@@ -0,0 +1,54 @@
+#ifndef _WIN32
+
+#include <stdio.h>
+#include <locale.h>
+#include <unistd.h>
+
+#include "Console_utils.h"
+
+//ANSI escape sequences, written only if console is a terminal
+
+static int ansiColorIndex(consoleColor color){
+    return ((color & COLOR_RED  ) ? 1 : 0) |
+           ((color & COLOR_GREEN) ? 2 : 0) |
+           ((color & COLOR_BLUE ) ? 4 : 0);
+}
+
+bool setConsoleColor(FILE* console, consoleColor text_color, consoleColor background_color){
+    if (console == nullptr || !isatty(fileno(console)))
+        return 0;
+
+    if (text_color == COLOR_DEFAULTT){
+        fputs("\x1b[0m", console);
+        return 1;
+    }
+
+    int text = ((text_color & COLOR_INTENSE)? 90 : 30) + ansiColorIndex(text_color);
+    //black background is the default one, terminal background is left as is
+    if (background_color == COLOR_BLACK){
+        fprintf(console, "\x1b[%dm", text);
+    }
+    else{
+        int background = ((background_color & COLOR_INTENSE)? 100 : 40) + ansiColorIndex(background_color);
+        fprintf(console, "\x1b[%d;%dm", text, background);
+    }
+    return 1;
+}
+
+void initConsole(){
+    setlocale (LC_ALL,     "");
+    setlocale (LC_NUMERIC, "C");
+}
+
+bool moveCursor(FILE* console, int dx, int dy){
+    if (console == nullptr || !isatty(fileno(console)))
+        return 0;
+
+    if (dx > 0) fprintf(console, "\x1b[%dC",  dx);
+    if (dx < 0) fprintf(console, "\x1b[%dD", -dx);
+    if (dy > 0) fprintf(console, "\x1b[%dB",  dy);
+    if (dy < 0) fprintf(console, "\x1b[%dA", -dy);
+    return 1;
+}
+
+#endif // _WIN32
@@ -1,8 +1,8 @@
+#ifdef _WIN32
+
 #include <stdio.h>
 #include <locale.h>
-#include <assert.h>
 #include <wchar.h>
-#include <string.h>
 #include <windows.h>
 
 #include "Console_utils.h"
@@ -74,35 +74,4 @@ bool moveCursor(FILE* console, int dx, int dy){
     return SetConsoleCursorPosition  (console_handle, screen_info.dwCursorPosition);
 }
 
-
-void createProgressBar(FILE* out, int total, int filled, const char* bar_string, consoleColor color_full, consoleColor color_empty){
-    assert(strlen(bar_string) >= 5);
-    fputc(bar_string[0], out);
-    if (!(color_full & COLOR_NOCHANGE)){
-        fflush(out);
-        setConsoleColor(out, color_full, COLOR_BLACK);
-    }
-    for (int x = 0; x < filled; x++)
-        fputc(bar_string[1], out);
-    if (!(color_empty & COLOR_NOCHANGE)){
-        fflush(out);
-        setConsoleColor(out, color_empty, COLOR_BLACK);
-    }
-
-
-    if (filled != total)
-        fputc(bar_string[2], out);
-    for (int x = filled+1; x < total; x++)
-        fputc(bar_string[3], out);
-
-    fputc(bar_string[4], out);
-    fflush(out);
-}
-void createNormalProgressBar(FILE* out, int total, int filled){
-    createProgressBar(out, total, filled, "[=  ]", COLOR_GREEN, COLOR_DEFAULTT);
-}
-
-void createSimpleProgressBar(FILE* out, int total, int filled){
-    createProgressBar(out, total, filled, "[=  ]", COLOR_NOCHANGE, COLOR_NOCHANGE);
-}
-
+#endif // _WIN32
@@ -0,0 +1,716 @@
+#ifndef SEGSTACK_H_INCLUDED
+#define SEGSTACK_H_INCLUDED
+
+#include "Stack.h"
+
+//Segmented stack: elements live in a chain of chunks and are never moved by push,
+//so a pointer to an element (stackTopPtr) stays valid until that element is popped.
+//First chunk has seg_chunk elements, every next one growth_num/growth_den times more, up to
+//seg_chunk_max (seg_chunk_max == seg_chunk gives fixed size chunks). Worst push allocates,
+//poisons and hashes one chunk, so it is bounded by seg_chunk_max, not by stack size.
+//A chunk emptied by pop is kept as the spare and reused by the next push, at most one is kept.
+//Chunk is [header][canary][elements][canary] in one allocation, header hash covers chunk data hash.
+//Chunk data hash covers used elements and is always live (updated in O(1) by push and pop).
+//Chunks below the top one are full and do not change: stackError checks the struct, the top chunk
+//and the spare header without reading data, stackVerifyData rereads every chunk.
+//Verify policy works as for StackT: full level runs stackVerifyData before each op, which is O(size),
+//cheap and sampled levels keep ops O(1) (sampled rereads all chunks every every_n_ops ops or every_ms ms).
+//Policy: protect, canary, hash, poison and stats are used. hash_live, stats_time,
+//inline buffer, guard pages and bg verifier are not
+
+template<typename elem_t, bool hash>
+struct SegStackChunk{
+    SegStackChunk* prev;     //chunk below, nullptr for the bottom one
+    size_t         base;     //stack index of the first element
+    size_t         capacity;
+    [[no_unique_address]] StackField<hash, hash_t, 3> data_hash;
+    [[no_unique_address]] StackField<hash, hash_t, 4> chunk_hash; //covers [prev, chunk_hash)
+};
+
+template<typename elem_t, class policy_t = StackPolicyFull, class traits_t = StackElemTraits<elem_t>>
+struct SegStackT{
+    typedef elem_t   elem_type;
+    typedef policy_t policy_type;
+    typedef traits_t traits_type;
+
+    static constexpr bool   protect       = policy_t::protect;
+    static constexpr bool   canary        = protect && policy_t::canary;
+    static constexpr bool   hash          = protect && policy_t::hash;
+    static constexpr bool   poison        = protect && policy_t::poison;
+    static constexpr bool   stats         = policy_t::stats;
+    static constexpr size_t seg_chunk     = policy_t::seg_chunk;
+    static constexpr size_t seg_chunk_max = policy_t::seg_chunk_max;
+    static constexpr size_t growth_num    = policy_t::growth_num;
+    static constexpr size_t growth_den    = policy_t::growth_den;
+
+    typedef SegStackChunk<elem_t, hash> chunk_type;
+
+    static_assert(seg_chunk != 0, "segmented stack chunk must hold at least one element");
+    static_assert(seg_chunk_max >= seg_chunk, "segmented stack chunks must not shrink");
+    static_assert(growth_num > growth_den, "stack growth factor must be > 1");
+    static_assert(std::is_trivially_copyable_v<elem_t>, "segmented stack assigns to unused slots, use StackT for this type");
+
+    //data follows the header and left canary, aligned for elem_t
+    static constexpr size_t elem_align        = (alignof(elem_t) > alignof(canary_t))? alignof(elem_t) : alignof(canary_t);
+    static constexpr size_t header_size       = (sizeof(chunk_type) + elem_align - 1) / elem_align * elem_align;
+    static constexpr size_t data_begin_offset = !canary                             ? 0 :
+                                                (alignof(elem_t) > sizeof(canary_t))? alignof(elem_t) : sizeof(canary_t);
+    static constexpr size_t data_size_offset  = canary ? data_begin_offset + sizeof(canary_t) : 0;
+
+    //struct hash covers [top, verify_ops), which has no padding
+    [[no_unique_address]] StackField<canary , canary_t, 0> leftcan;
+
+    chunk_type* top;   //chunk with the top element, nullptr if stack is empty
+    chunk_type* spare; //empty chunk right above top, or nullptr
+    size_t      size;
+
+    const StackAllocator* allocator; //chunk allocator, see stackSetAllocator
+
+    [[no_unique_address]] StackField<protect, StackVerifyPolicy, 2> verify;
+    //sampling state, changes on every sampled op so it is not covered by struct hash
+    [[no_unique_address]] StackField<protect, unsigned int     , 5> verify_ops;
+    [[no_unique_address]] StackField<hash   , hash_t           , 4> struct_hash;
+    [[no_unique_address]] StackField<protect, uint64_t         , 6> verify_last_ms;
+
+    [[no_unique_address]] StackField<stats  , StackStats, 9> stats_data;
+    [[no_unique_address]] StackField<protect, VarInfo   , 1> info;
+
+    [[no_unique_address]] StackField<canary , canary_t, 8> rightcan;
+};
+
+#ifdef SEG_STACK_TEMPLATE
+    #error redefinition of internal macro SEG_STACK_TEMPLATE
+#endif
+#define SEG_STACK_TEMPLATE template<typename elem_t, class policy_t, class traits_t>
+#ifdef SEG_STACK_T
+    #error redefinition of internal macro SEG_STACK_T
+#endif
+#define SEG_STACK_T SegStackT<elem_t, policy_t, traits_t>
+
+SEG_STACK_TEMPLATE
+inline elem_t* segStackChunkData(const SegStackChunk<elem_t, SEG_STACK_T::hash>* chunk){
+    return (elem_t*)((char*)chunk + SEG_STACK_T::header_size + SEG_STACK_T::data_begin_offset);
+}
+
+SEG_STACK_TEMPLATE
+inline size_t segStackChunkMemSize(const SegStackChunk<elem_t, SEG_STACK_T::hash>* chunk){
+    return SEG_STACK_T::header_size + SEG_STACK_T::data_size_offset + chunk->capacity * sizeof(elem_t);
+}
+
+//elements in use in chunk: all below top, none in spare
+SEG_STACK_TEMPLATE
+inline size_t segStackChunkUsed(const SEG_STACK_T* stk, const typename SEG_STACK_T::chunk_type* chunk){
+    if (chunk == stk->top)
+        return stk->size - chunk->base;
+    if (chunk == stk->spare)
+        return 0;
+    return chunk->capacity;
+}
+
+//next push needs another chunk
+SEG_STACK_TEMPLATE
+inline bool segStackTopFull(const SEG_STACK_T* stk){
+    return stk->top == nullptr || stk->size == stk->top->base + stk->top->capacity;
+}
+
+//live hash of used elements, push and pop update it without rescanning the chunk
+SEG_STACK_TEMPLATE
+hash_t segStackChunkDataHash(const SegStackChunk<elem_t, SEG_STACK_T::hash>* chunk, size_t used){
+    const elem_t* data = segStackChunkData<elem_t, policy_t, traits_t>(chunk);
+    return gnuHashFast(data, data + used);
+}
+
+template<typename elem_t>
+hash_t segStackChunkHash(const SegStackChunk<elem_t, true>* chunk){
+    return gnuHashFast(&(chunk->prev), &(chunk->chunk_hash));
+}
+
+SEG_STACK_TEMPLATE
+hash_t segStackStructHash(const SEG_STACK_T* stk){
+    static_assert(SEG_STACK_T::hash, "stack policy has no hash");
+    return gnuHashFast(&(stk->top), &(stk->verify_ops));
+}
+
+//hashes to update after an operation on chunk, its data hash is already updated
+SEG_STACK_TEMPLATE
+void segStackUpdHashesOp(SEG_STACK_T* stk, typename SEG_STACK_T::chunk_type* chunk){
+    if constexpr (SEG_STACK_T::hash){
+        chunk->chunk_hash = segStackChunkHash(chunk);
+        stk->struct_hash  = segStackStructHash(stk);
+    }
+}
+
+//new empty chunk above prev, nullptr if out of memory
+SEG_STACK_TEMPLATE
+typename SEG_STACK_T::chunk_type* segStackChunkAlloc(SEG_STACK_T* stk, typename SEG_STACK_T::chunk_type* prev){
+    typedef typename SEG_STACK_T::chunk_type chunk_type;
+
+    size_t capacity = SEG_STACK_T::seg_chunk;
+    size_t base     = 0;
+    if (prev != nullptr){
+        base     = prev->base + prev->capacity;
+        capacity = prev->capacity * SEG_STACK_T::growth_num / SEG_STACK_T::growth_den;
+        if (capacity <= prev->capacity)
+            capacity = prev->capacity + 1;
+        if (capacity > SEG_STACK_T::seg_chunk_max)
+            capacity = SEG_STACK_T::seg_chunk_max;
+    }
+
+    size_t mem_size = SEG_STACK_T::header_size + SEG_STACK_T::data_size_offset + capacity * sizeof(elem_t);
+    errno = 0;
+    chunk_type* chunk = (chunk_type*)stk->allocator->alloc(stk->allocator->ctx, mem_size);
+    if (chunk == nullptr)
+        return nullptr;
+
+    chunk->prev     = prev;
+    chunk->base     = base;
+    chunk->capacity = capacity;
+
+    elem_t* data = segStackChunkData<elem_t, policy_t, traits_t>(chunk);
+    if constexpr (SEG_STACK_T::canary){
+        setRCanary(data, capacity * sizeof(elem_t));
+        setLCanary(data);
+    }
+    if constexpr (SEG_STACK_T::poison){
+        for (size_t i = 0; i < capacity; i++)
+            data[i] = traits_t::poison();
+    }
+    if constexpr (SEG_STACK_T::hash){
+        chunk->data_hash  = segStackChunkDataHash<elem_t, policy_t, traits_t>(chunk, 0);
+        chunk->chunk_hash = segStackChunkHash(chunk);
+    }
+    if constexpr (SEG_STACK_T::protect)
+        ptrTrack(chunk, mem_size);
+    if constexpr (SEG_STACK_T::stats){
+        stk->stats_data.grows++;
+        stk->stats_data.realloc_bytes += mem_size;
+    }
+    return chunk;
+}
+
+SEG_STACK_TEMPLATE
+void segStackChunkFree(SEG_STACK_T* stk, typename SEG_STACK_T::chunk_type* chunk){
+    if constexpr (SEG_STACK_T::protect)
+        ptrUntrack(chunk);
+    stk->allocator->free(stk->allocator->ctx, chunk, segStackChunkMemSize<elem_t, policy_t, traits_t>(chunk));
+    if constexpr (SEG_STACK_T::stats)
+        stk->stats_data.shrinks++;
+}
+
+SEG_STACK_TEMPLATE
+bool stackCtor_(SEG_STACK_T* stk, VarInfo info){
+    if constexpr (SEG_STACK_T::protect){
+        if (isBadWritePtr(stk, sizeof(*stk))){
+            return false;
+        }
+    }
+    stk->top       = nullptr;
+    stk->spare     = nullptr;
+    stk->size      = 0;
+    stk->allocator = &stack_malloc_allocator;
+
+    if constexpr (SEG_STACK_T::stats)
+        stk->stats_data = {};
+    if constexpr (SEG_STACK_T::protect){
+        ptrTrack(stk, sizeof(*stk));
+        stk->info           = info;
+        stk->verify         = stack_default_verify_policy;
+        stk->verify_ops     = 0;
+        stk->verify_last_ms = monotonicTimeMs();
+    }
+    if constexpr (SEG_STACK_T::canary){
+        stk->leftcan  = CANARY_L;
+        stk->rightcan = CANARY_R;
+    }
+    if constexpr (SEG_STACK_T::hash)
+        stk->struct_hash = segStackStructHash(stk);
+    return true;
+}
+
+//header and data of one chunk with `used` elements. Header hash is checked first,
+//nothing else is trusted if it is bad
+SEG_STACK_TEMPLATE
+unsigned int segStackChunkError(const SegStackChunk<elem_t, SEG_STACK_T::hash>* chunk, size_t used, bool rescan_data){
+    if (isBadWritePtr((void*)chunk, SEG_STACK_T::header_size))
+        return STACK_DATA_BAD;
+
+    if constexpr (SEG_STACK_T::hash){
+        if (chunk->chunk_hash != segStackChunkHash(chunk))
+            return STACK_HASH_BAD;
+    }
+    if (used > chunk->capacity)
+        return STACK_SIZE_CAP_BAD;
+
+    unsigned int err = 0;
+    if constexpr (SEG_STACK_T::canary){
+        const elem_t* data = segStackChunkData<elem_t, policy_t, traits_t>(chunk);
+        if (!checkLCanary(data))
+            err |= STACK_DATA_CANARY_L_BAD;
+        if (!checkRCanary(data, chunk->capacity * sizeof(elem_t)))
+            err |= STACK_DATA_CANARY_R_BAD;
+    }
+    if constexpr (SEG_STACK_T::hash){
+        if (rescan_data && chunk->data_hash != segStackChunkDataHash<elem_t, policy_t, traits_t>(chunk, used))
+            err |= STACK_DATA_HASH_BAD;
+    }
+    return err;
+}
+
+//struct, top chunk and spare header. O(1), chunk data is not reread
+SEG_STACK_TEMPLATE
+stackError_t stackError(const SEG_STACK_T* stk){
+    if (stk == nullptr)
+        return STACK_NULL;
+
+    if (isBadReadPtr(stk, sizeof(*stk)))
+        return STACK_BAD;
+
+    if (stk->size == SIZE_MAX || stk->top == stackDestructPtr<typename SEG_STACK_T::chunk_type>())
+        return STACK_DEAD;
+
+    unsigned int err = 0;
+    if constexpr (SEG_STACK_T::canary){
+        if (stk->leftcan != CANARY_L)
+            err |= STACK_CANARY_L_BAD;
+        if (stk->rightcan != CANARY_R)
+            err |= STACK_CANARY_R_BAD;
+    }
+    if constexpr (SEG_STACK_T::hash){
+        //chunk pointers can not be followed
+        if (stk->struct_hash != segStackStructHash(stk))
+            return (stackError_t)(err | STACK_HASH_BAD);
+    }
+
+    if (stk->top == nullptr){
+        if (stk->size != 0)
+            err |= STACK_SIZE_CAP_BAD;
+    }
+    else{
+        if (isBadWritePtr(stk->top, SEG_STACK_T::header_size))
+            return (stackError_t)(err | STACK_DATA_BAD);
+        if (stk->size <= stk->top->base)
+            err |= STACK_SIZE_CAP_BAD;
+        else
+            err |= segStackChunkError<elem_t, policy_t, traits_t>(stk->top, stk->size - stk->top->base, false);
+    }
+
+    if (stk->spare != nullptr){
+        err |= segStackChunkError<elem_t, policy_t, traits_t>(stk->spare, 0, false);
+        if (!(err & (STACK_DATA_BAD | STACK_HASH_BAD)) && stk->spare->prev != stk->top)
+            err |= STACK_DATA_BAD;
+    }
+    return (stackError_t)err;
+}
+
+//stackError and every chunk: headers, links and data hashes
+SEG_STACK_TEMPLATE
+stackError_t stackVerifyData(const SEG_STACK_T* stk){
+    unsigned int err = stackError(stk);
+    if (err & (STACK_NULL | STACK_BAD | STACK_DEAD | STACK_DATA_BAD | STACK_HASH_BAD))
+        return (stackError_t)err;
+
+    if (stk->top != nullptr)
+        err |= segStackChunkError<elem_t, policy_t, traits_t>(stk->top, stk->size - stk->top->base, true);
+    if (stk->spare != nullptr)
+        err |= segStackChunkError<elem_t, policy_t, traits_t>(stk->spare, 0, true);
+    //base goes down by the capacity of every chunk, so a corrupted chain still ends
+    for (const typename SEG_STACK_T::chunk_type* chunk = stk->top; chunk != nullptr; chunk = chunk->prev){
+        const typename SEG_STACK_T::chunk_type* prev = chunk->prev;
+        if (prev == nullptr){
+            if (chunk->base != 0)
+                err |= STACK_DATA_BAD;
+            break;
+        }
+        unsigned int chunk_err = segStackChunkError<elem_t, policy_t, traits_t>(prev, prev->capacity, true);
+        err |= chunk_err;
+        if ((chunk_err & (STACK_DATA_BAD | STACK_HASH_BAD)) || prev->base + prev->capacity != chunk->base){
+            err |= STACK_DATA_BAD;
+            break;
+        }
+    }
+    return (stackError_t)err;
+}
+
+SEG_STACK_TEMPLATE
+inline stackError_t stackCountError(SEG_STACK_T* stk, stackError_t err){
+    if constexpr (SEG_STACK_T::stats){
+        if (err == STACK_NOERROR || (err & (STACK_NULL | STACK_BAD)))
+            return err;
+        for (int bit = 0; bit < STACK_ERROR_BITS; bit++){
+            if (err & (1u << bit))
+                stk->stats_data.errors[bit]++;
+        }
+    }
+    return err;
+}
+
+//O(1): left struct canary, size against top chunk and its data canaries. No pointer probes, no hashing
+SEG_STACK_TEMPLATE
+stackError_t stackErrorCheap(const SEG_STACK_T* stk){
+    if (stk == nullptr)
+        return STACK_NULL;
+
+    if (stk->size == SIZE_MAX || stk->top == stackDestructPtr<typename SEG_STACK_T::chunk_type>())
+        return STACK_DEAD;
+
+    unsigned int err = 0;
+    if constexpr (SEG_STACK_T::canary){
+        if (stk->leftcan != CANARY_L)
+            return STACK_CANARY_L_BAD;
+    }
+
+    const typename SEG_STACK_T::chunk_type* top = stk->top;
+    if (top == nullptr){
+        if (stk->size != 0)
+            err |= STACK_SIZE_CAP_BAD;
+    }
+    else if (stk->size <= top->base || stk->size > top->base + top->capacity){
+        err |= STACK_SIZE_CAP_BAD;
+    }
+    else if constexpr (SEG_STACK_T::canary){
+        const elem_t* data = segStackChunkData<elem_t, policy_t, traits_t>(top);
+        if (!checkLCanary(data))
+            err |= STACK_DATA_CANARY_L_BAD;
+        if (!checkRCanary(data, top->capacity * sizeof(elem_t)))
+            err |= STACK_DATA_CANARY_R_BAD;
+    }
+    return (stackError_t)err;
+}
+
+//check done before each operation, according to stack verify policy
+SEG_STACK_TEMPLATE
+stackError_t stackCheck(SEG_STACK_T* stk){
+    if constexpr (SEG_STACK_T::protect){
+        if (stk == nullptr)
+            return STACK_NULL;
+
+        stackError_t err = STACK_NOERROR;
+        switch (stk->verify.level){
+        case STACK_VERIFY_OFF:
+            break;
+        case STACK_VERIFY_CHEAP:
+            err = stackErrorCheap(stk);
+            break;
+        case STACK_VERIFY_SAMPLED:
+            err = stackErrorCheap(stk);
+            if (err == STACK_NOERROR && stackVerifyPolicyDue(&(stk->verify), &(stk->verify_ops), &(stk->verify_last_ms)))
+                err = stackVerifyData(stk);
+            break;
+        default: //full, or policy itself is corrupted
+            err = stackVerifyData(stk);
+            break;
+        }
+        return stackCountError(stk, err);
+    }
+    else{
+        return STACK_NOERROR;
+    }
+}
+
+//check done after operations, does not advance sampling
+SEG_STACK_TEMPLATE
+stackError_t stackError_dbg(SEG_STACK_T* stk){
+    if constexpr (SEG_STACK_T::protect){
+        if (stk == nullptr)
+            return STACK_NULL;
+
+        stackError_t err = STACK_NOERROR;
+        switch (stk->verify.level){
+        case STACK_VERIFY_OFF:
+            break;
+        case STACK_VERIFY_CHEAP:
+        case STACK_VERIFY_SAMPLED:
+            err = stackErrorCheap(stk);
+            break;
+        default: //data was checked before the op, chunk hash was updated by it
+            err = stackError(stk);
+            break;
+        }
+        return stackCountError(stk, err);
+    }
+    else{
+        return STACK_NOERROR;
+    }
+}
+
+SEG_STACK_TEMPLATE
+void segStackDumpChunk(const SEG_STACK_T* stk, const typename SEG_STACK_T::chunk_type* chunk,
+                       const StackDumpOptions* opt, LogTextBuf* buf){
+    size_t used = segStackChunkUsed(stk, chunk);
+    logBufPrintf(buf, "      Chunk %p: [%zu, %zu), %zu used%s\n", chunk, chunk->base, chunk->base + chunk->capacity,
+                 used, (chunk == stk->spare)? " (spare)" : "");
+
+    unsigned int err = segStackChunkError<elem_t, policy_t, traits_t>(chunk, used, true);
+    if (err & STACK_DATA_BAD){
+        logBufPrintf(buf, "      (BAD)  Chunk pointer is invalid\n");
+        return;
+    }
+    if constexpr (SEG_STACK_T::hash){
+        if (err & STACK_HASH_BAD){
+            logBufPrintf(buf, "      (BAD)  Chunk hash invalid. Written %p calculated %p\n",
+                         chunk->chunk_hash, segStackChunkHash(chunk));
+            return;
+        }
+        if (err & STACK_DATA_HASH_BAD)
+            logBufPrintf(buf, "      (BAD)  Chunk data hash invalid. Written %p calculated %p\n",
+                         chunk->data_hash, segStackChunkDataHash<elem_t, policy_t, traits_t>(chunk, used));
+    }
+    const elem_t* data = segStackChunkData<elem_t, policy_t, traits_t>(chunk);
+    if constexpr (SEG_STACK_T::canary){
+        if (err & STACK_DATA_CANARY_L_BAD)
+            logBufPrintf(buf, "      (BAD)  Data L canary BAD! Value: %p\n", getLCanary(data));
+        if (err & STACK_DATA_CANARY_R_BAD)
+            logBufPrintf(buf, "      (BAD)  Data R canary BAD! Value: %p\n", getRCanary(data, chunk->capacity * sizeof(elem_t)));
+    }
+
+    //elements in the first opt->head and last opt->tail of the stack
+    size_t tail_begin = (stk->size > opt->tail)? stk->size - opt->tail : 0;
+    size_t skipped    = 0;
+    for (size_t i = 0; i < used; i++){
+        size_t index = chunk->base + i;
+        if (index >= opt->head && index < tail_begin){
+            skipped++;
+            continue;
+        }
+        if (skipped != 0)
+            logBufPrintf(buf, "    ... %zu slots skipped\n", skipped);
+        skipped = 0;
+        logBufPrintf(buf, "    *[%zu] ", index);
+        stackDumpElem<elem_t, traits_t>(buf, data[i]);
+        logBufPrintf(buf, "%s", (traits_t::isPoison(data[i])) ? " (POISON)\n":" \n");
+    }
+    if (skipped != 0)
+        logBufPrintf(buf, "    ... %zu slots skipped\n", skipped);
+}
+
+//chunks are listed from the top one down, spare first
+SEG_STACK_TEMPLATE
+void stackDump(const SEG_STACK_T* stk, const StackDumpOptions* opt){
+    if (!LOG_ENABLED(LOG_LEVEL_INFO))
+        return;
+
+    info_log("Segmented stack dump:\n      stack at %p \n", stk);
+
+    stackError_t err = stackVerifyData(stk);
+    if (err & STACK_NULL){
+        printf_log("      (BAD)  Stack poiner is null\n");
+        return;
+    }
+    if (err & STACK_BAD){
+        printf_log("      (BAD)  Stack poiner is invalid\n");
+        return;
+    }
+
+    printf_log("      %zu elements\n", stk->size);
+    printf_log("      Top chunk: %p, spare: %p\n", stk->top, stk->spare);
+
+    if (err & STACK_DEAD){
+        printf_log("      (BAD)  Stack was already destructed\n\n");
+        return;
+    }
+
+    if constexpr (SEG_STACK_T::protect)
+        printVarInfo_log(&(stk->info));
+
+    if constexpr (SEG_STACK_T::stats){
+        if (opt->stats)
+            stackPrintStats(&(stk->stats_data));
+    }
+
+    if constexpr (SEG_STACK_T::canary){
+        if (err & STACK_CANARY_L_BAD){
+            printf_log("      (BAD)  Struct L canary BAD! Value: %p\n", stk->leftcan);
+        }
+        if (err & STACK_CANARY_R_BAD){
+            printf_log("      (BAD)  Struct R canary BAD! Value: %p\n", stk->rightcan);
+        }
+    }
+    if constexpr (SEG_STACK_T::hash){
+        if (stk->struct_hash != segStackStructHash(stk)){
+            printf_log("      (BAD)  Struct hash invalid. Written %p calculated %p\n\n", stk->struct_hash, segStackStructHash(stk));
+            return;
+        }
+    }
+    if (err & STACK_SIZE_CAP_BAD){
+        printf_log("      (BAD)  Stack size does not match top chunk\n");
+    }
+    printf_log("\n");
+
+    LogTextBuf buf = {};
+    if (stk->spare != nullptr)
+        segStackDumpChunk(stk, stk->spare, opt, &buf);
+    for (const typename SEG_STACK_T::chunk_type* chunk = stk->top; chunk != nullptr; chunk = chunk->prev){
+        segStackDumpChunk(stk, chunk, opt, &buf);
+        if (segStackChunkError<elem_t, policy_t, traits_t>(chunk, segStackChunkUsed(stk, chunk), false) &
+            (STACK_DATA_BAD | STACK_HASH_BAD))
+            break;
+    }
+    logBufPrintf(&buf, "\n");
+    logBufFlush(&buf);
+    logBufFree (&buf);
+}
+
+SEG_STACK_TEMPLATE
+void stackDump(const SEG_STACK_T* stk){
+    stackDump(stk, &stack_default_dump_options);
+}
+
+SEG_STACK_TEMPLATE
+stackError_t stackSetVerifyPolicy(SEG_STACK_T* stk, StackVerifyPolicy policy){
+    if constexpr (SEG_STACK_T::protect){
+        stackCheckRet(stk);
+        stk->verify     = policy;
+        stk->verify_ops = 0;
+        if constexpr (SEG_STACK_T::hash)
+            stk->struct_hash = segStackStructHash(stk);
+    }
+    return STACK_NOERROR;
+}
+
+//allocator must outlive the stack. Can only be changed while stack has no chunks
+SEG_STACK_TEMPLATE
+stackError_t stackSetAllocator(SEG_STACK_T* stk, const StackAllocator* allocator){
+    stackCheckRet(stk);
+    if (allocator == nullptr || stk->top != nullptr || stk->spare != nullptr)
+        return STACK_OP_INVALID;
+    stk->allocator = allocator;
+    if constexpr (SEG_STACK_T::hash)
+        stk->struct_hash = segStackStructHash(stk);
+    return STACK_NOERROR;
+}
+
+SEG_STACK_TEMPLATE
+stackError_t stackDtor(SEG_STACK_T* stk){
+    stackCheckRet(stk);
+    if constexpr (SEG_STACK_T::hash){
+        if (stackVerifyData(stk)){
+            error_log("%s", "Stack data hash error");
+            stackDump(stk);
+            return stackVerifyData(stk);
+        }
+    }
+
+    if (stk->spare != nullptr)
+        segStackChunkFree(stk, stk->spare);
+    typename SEG_STACK_T::chunk_type* chunk = stk->top;
+    while (chunk != nullptr){
+        typename SEG_STACK_T::chunk_type* prev = chunk->prev;
+        segStackChunkFree(stk, chunk);
+        chunk = prev;
+    }
+    if constexpr (SEG_STACK_T::protect)
+        ptrUntrack(stk);
+
+    stk->top   = stackDestructPtr<typename SEG_STACK_T::chunk_type>();
+    stk->spare = nullptr;
+    stk->size  = -1;
+    if constexpr (SEG_STACK_T::protect)
+        (stk->info).status = VARSTATUS_DEAD;
+    return STACK_NOERROR;
+}
+
+SEG_STACK_TEMPLATE
+stackError_t stackPush(SEG_STACK_T* stk, typename SEG_STACK_T::elem_type elem){
+    stackCheckRet(stk);
+    if constexpr (SEG_STACK_T::protect){
+        if (stk->size == 0)
+            (stk->info).status = VARSTATUS_NORMAL;
+    }
+
+    if (segStackTopFull(stk)){
+        typename SEG_STACK_T::chunk_type* next = stk->spare;
+        if (next == nullptr){
+            next = segStackChunkAlloc(stk, stk->top);
+            if (next == nullptr){
+                perror_log("error while allocating memory for stack chunk");
+                return stackCountError(stk, STACK_OP_ERROR);
+            }
+        }
+        stk->spare = nullptr;
+        stk->top   = next;
+    }
+
+    typename SEG_STACK_T::chunk_type* chunk = stk->top;
+    elem_t* slot = segStackChunkData<elem_t, policy_t, traits_t>(chunk) + (stk->size - chunk->base);
+    *slot = elem;
+    stk->size++;
+    if constexpr (SEG_STACK_T::hash)
+        chunk->data_hash = gnuHashAppend(chunk->data_hash, slot, slot + 1);
+    segStackUpdHashesOp(stk, chunk);
+
+    if constexpr (SEG_STACK_T::stats){
+        stk->stats_data.pushes++;
+        if (stk->size > stk->stats_data.high_water)
+            stk->stats_data.high_water = stk->size;
+    }
+    return stackError_dbg(stk);
+}
+
+//pointer to the top element, valid until it is popped. nullptr if stack is empty or broken
+SEG_STACK_TEMPLATE
+const elem_t* stackTopPtr(SEG_STACK_T* stk, stackError_t *err_ptr = nullptr){
+    stackCheckRetPtr(stk, err_ptr, nullptr);
+
+    if (stk->size == 0){
+        stackError_t err = stackCountError(stk, STACK_OP_INVALID);
+        if (err_ptr)
+            *err_ptr = err;
+        return nullptr;
+    }
+    return segStackChunkData<elem_t, policy_t, traits_t>(stk->top) + (stk->size - 1 - stk->top->base);
+}
+
+SEG_STACK_TEMPLATE
+elem_t stackTop(SEG_STACK_T* stk, stackError_t *err_ptr = nullptr){
+    const elem_t* top = stackTopPtr(stk, err_ptr);
+    return (top != nullptr)? *top : traits_t::poison();
+}
+
+SEG_STACK_TEMPLATE
+elem_t stackPop(SEG_STACK_T* stk, stackError_t *err_ptr = nullptr){
+    stackCheckRetPtr(stk, err_ptr, traits_t::poison());
+
+    if (stk->size == 0){
+        stackError_t err = stackCountError(stk, STACK_OP_INVALID);
+        if (err_ptr)
+            *err_ptr = err;
+        return traits_t::poison();
+    }
+
+    typename SEG_STACK_T::chunk_type* chunk = stk->top;
+    elem_t* slot = segStackChunkData<elem_t, policy_t, traits_t>(chunk) + (--stk->size - chunk->base);
+    elem_t ret = *slot;
+    if constexpr (SEG_STACK_T::hash)
+        chunk->data_hash = (chunk->data_hash - gnuHashAppend(0, slot, slot + 1)) * stack_elem_hash_inv<elem_t>;
+    if constexpr (SEG_STACK_T::poison)
+        *slot = traits_t::poison();
+
+    //emptied chunk becomes the spare, the old spare above it is not needed any more
+    if (stk->size == chunk->base){
+        if (stk->spare != nullptr)
+            segStackChunkFree(stk, stk->spare);
+        stk->spare = chunk;
+        stk->top   = chunk->prev;
+    }
+    segStackUpdHashesOp(stk, chunk);
+
+    if constexpr (SEG_STACK_T::stats)
+        stk->stats_data.pops++;
+    return ret;
+}
+
+SEG_STACK_TEMPLATE
+stackError_t stackGetStats(const SEG_STACK_T* stk, StackStats* stats){
+    if (stk == nullptr || stats == nullptr)
+        return STACK_NULL;
+    if constexpr (SEG_STACK_T::stats){
+        *stats = stk->stats_data;
+        return STACK_NOERROR;
+    }
+    else{
+        *stats = {};
+        return STACK_OP_INVALID;
+    }
+}
+
+#endif // SEGSTACK_H_INCLUDED
@@ -1,10 +1,22 @@
+#ifndef STACK_H_INCLUDED
+#define STACK_H_INCLUDED
+
 #include <stdio.h>
 #include <stdlib.h>
-#include <windows.h>
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <memory>
+#include <new>
 
 #include "asserts.h"
 #include "logging.h"
 #include "debug_utils.h"
+#include "alloc_utils.h"
+#include "ptr_utils.h"
 
 
 enum stackError_t{
@@ -29,175 +41,721 @@ enum stackError_t{
     STACK_OP_ERROR          = 1 << 25
 };
 
-#ifdef NDEBUG
-    #define STACK_NO_PROTECT
-#endif
+static const int STACK_ERROR_BITS = 32;
+
+//name of error bit number `bit`, nullptr for unused bits
+inline const char* stackErrorName(int bit){
+    switch (1u << bit){
+    case STACK_NULL:              return "STACK_NULL";
+    case STACK_BAD:               return "STACK_BAD";
+    case STACK_DEAD:              return "STACK_DEAD";
+    case STACK_DATA_NULL:         return "STACK_DATA_NULL";
+    case STACK_DATA_BAD:          return "STACK_DATA_BAD";
+    case STACK_SIZE_CAP_BAD:      return "STACK_SIZE_CAP_BAD";
+    case STACK_CANARY_L_BAD:      return "STACK_CANARY_L_BAD";
+    case STACK_CANARY_R_BAD:      return "STACK_CANARY_R_BAD";
+    case STACK_DATA_CANARY_L_BAD: return "STACK_DATA_CANARY_L_BAD";
+    case STACK_DATA_CANARY_R_BAD: return "STACK_DATA_CANARY_R_BAD";
+    case STACK_HASH_BAD:          return "STACK_HASH_BAD";
+    case STACK_DATA_HASH_BAD:     return "STACK_DATA_HASH_BAD";
+    case STACK_OP_INVALID:        return "STACK_OP_INVALID";
+    case STACK_OP_ERROR:          return "STACK_OP_ERROR";
+    default:                      return nullptr;
+    }
+}
 
-#ifdef STACK_NO_PROTECT
-    #define STACK_NO_HASH
-    #define STACK_NO_CANARY
-#endif
+//Compile-time stack policies. Custom policy can derive from one of these and hide some fields:
+//  struct MyPolicy : StackPolicyFull { static constexpr size_t min_size = 64; };
+//Everything disabled by the policy is removed from both the struct and the code
+struct StackPolicyFull{
+    static constexpr bool   protect     = true;  //VarInfo, verify policy, pointer checks
+    static constexpr bool   canary      = true;
+    static constexpr bool   hash        = true;
+    static constexpr bool   hash_live   = false; //data hash covers only [0, size) and is updated in O(1),
+                                                 //stackError does not rescan data, stackVerifyData and full or
+                                                 //sampled verify levels do
+    static constexpr bool   poison      = true;  //unused slots are filled with traits_t::poison()
+    static constexpr bool   bg_verifier = false; //stack can be registered in StackVerifier (StackVerifier.h)
+    static constexpr bool   stats       = true;  //count resizes, ops and errors, see stackGetStats
+    static constexpr bool   stats_time  = false; //also time checks and hash updates (two clock reads each)
+    static constexpr bool   guard_pages = false; //data buffer between PROT_NONE pages (stack_guard_allocator),
+                                                 //overrun faults and is reported. Replaces right data canary
+    static constexpr bool   elimination = false; //concurrent stack only (ConcStack.h): push and pop that
+                                                 //collide on head exchange the element in an elimination array
+    static constexpr size_t elimination_slots = 16;
+    static constexpr size_t seg_chunk   = 256;     //segmented stack only (SegStack.h): elements in the first chunk,
+    static constexpr size_t seg_chunk_max = 1 << 16; //next ones grow by growth factor up to seg_chunk_max elements
+    static constexpr size_t align       = 0;     //alignment of the stack struct, 0 = natural. STACK_CACHE_LINE starts
+                                                 //hot fields on a line boundary and keeps stacks in an array from false sharing
+
+    //growth: capacity*growth_num/growth_den when full.
+    //shrink: to size*shrink_mul when size*shrink_div < capacity, shrink_div = 0 means never shrink.
+    //shrink_div > shrink_mul leaves a gap between shrink and grow points, so push/pop near
+    //a boundary does not realloc every time
+    static constexpr size_t min_size    = 10;    //minimal capacity
+    static constexpr size_t inline_size = 0;     //elements kept in a buffer inside the struct, heap is used
+                                                 //only above that. Such stack must not be copied after stackCtor
+    static constexpr size_t growth_num  = 2;
+    static constexpr size_t growth_den  = 1;
+    static constexpr size_t shrink_div  = 4;
+    static constexpr size_t shrink_mul  = 2;
+};
 
-#ifndef ELEM_T
-    #define ELEM_T int
-#endif
+struct StackPolicyLiveHash : StackPolicyFull{
+    static constexpr bool   hash_live   = true;
+};
 
-#ifndef ELEM_SPEC
-    #define ELEM_SPEC "%d"
-#endif
+//protection without per-op data rescans: overruns are caught by the MMU,
+//underruns by the left data canary
+struct StackPolicyGuard : StackPolicyFull{
+    static constexpr bool   hash        = false;
+    static constexpr bool   guard_pages = true;
+};
 
-#ifndef BAD_ELEM
-    #define BAD_ELEM 133
-#endif
+struct StackPolicyNone : StackPolicyFull{
+    static constexpr bool   protect     = false;
+    static constexpr bool   canary      = false;
+    static constexpr bool   hash        = false;
+    static constexpr bool   poison      = false;
+    static constexpr bool   stats       = false;
+};
 
-#ifndef DESTRUCT_PTR
-    #define DESTRUCT_PTR ((ELEM_T*)0xBAD)
+//byte unused slots are filled with when element type has no poison value
+static const uint8_t STACK_POISON_BYTE = 0xBD;
+
+//Element traits: value used for poisoning and how to print element in dump.
+//Elements that are not trivially copyable are destroyed before their slot is poisoned,
+//so poison of such types is a byte pattern and poison() is only returned by failed ops
+template<typename elem_t>
+struct StackElemTraits{
+    static elem_t poison(){
+        if constexpr (std::is_trivially_copyable_v<elem_t>){
+            elem_t elem;
+            memset((void*)&elem, STACK_POISON_BYTE, sizeof(elem));
+            return elem;
+        }
+        else{
+            return elem_t();
+        }
+    }
+    static bool isPoison(const elem_t& elem){
+        for (size_t i = 0; i < sizeof(elem); i++){
+            if (((const uint8_t*)&elem)[i] != STACK_POISON_BYTE)
+                return false;
+        }
+        return true;
+    }
+    static void print(const elem_t& elem){
+        for (size_t i = 0; i < sizeof(elem); i++)
+            printf_log("%02x", ((const uint8_t*)&elem)[i]);
+    }
+};
+
+#ifdef STACK_ELEM_TRAITS
+    #error redefinition of internal macro STACK_ELEM_TRAITS
 #endif
+#define STACK_ELEM_TRAITS(__type, __spec, __poison)                     \
+    template<>                                                          \
+    struct StackElemTraits<__type>{                                     \
+        static __type poison()                    { return (__poison); }\
+        static bool isPoison(const __type& elem)  { return elem == (__poison); } \
+        static void print(const __type& elem)     { printf_log(__spec, elem); } \
+        static constexpr const char* spec = __spec;                     \
+    };
+
+STACK_ELEM_TRAITS(int               , "%d"  , 133        )
+STACK_ELEM_TRAITS(unsigned int      , "%u"  , 133        )
+STACK_ELEM_TRAITS(long              , "%ld" , 133        )
+STACK_ELEM_TRAITS(unsigned long     , "%lu" , 133        )
+STACK_ELEM_TRAITS(long long         , "%lld", 133        )
+STACK_ELEM_TRAITS(unsigned long long, "%llu", 133        )
+STACK_ELEM_TRAITS(char              , "%c"  , '\x85'     )
+STACK_ELEM_TRAITS(float             , "%g"  , 133.133f   )
+STACK_ELEM_TRAITS(double            , "%lg" , 133.133    )
+
+template<typename elem_t>
+struct StackElemTraits<elem_t*>{
+    static elem_t* poison()                    { return (elem_t*)0xBAD0; }
+    static bool isPoison(elem_t* const& elem)  { return elem == poison(); }
+    static void print(elem_t* const& elem)     { printf_log("%p", (const void*)elem); }
+    static constexpr const char* spec = "%p";
+};
 
-#ifndef STACK_MIN_SIZE
-    #define STACK_MIN_SIZE 10
+//elements that can be moved with memcpy/realloc, old copy is dropped without running destructor.
+//Trivially copyable types are, specialize for others that are (no pointers into the object itself)
+template<typename elem_t>
+struct StackRelocatable : std::is_trivially_copyable<elem_t>{};
+
+template<typename elem_t>
+struct StackRelocatable<std::unique_ptr<elem_t>> : std::true_type{};
+
+//printf spec of one element for binary log dumps, traits without it are dumped as hex bytes
+template<typename traits_t, typename = void>
+struct StackElemSpec{
+    static constexpr bool        has   = false;
+    static constexpr const char* value = "";
+};
+template<typename traits_t>
+struct StackElemSpec<traits_t, std::void_t<decltype(traits_t::spec)>>{
+    static constexpr bool        has   = true;
+    static constexpr const char* value = traits_t::spec;
+};
+
+
+enum stackVerifyLevel_t{
+    STACK_VERIFY_OFF     = 0,
+    STACK_VERIFY_CHEAP   = 1, //O(1): canaries and size/capacity invariants
+    STACK_VERIFY_FULL    = 2, //stackVerifyData before every operation (rescans data, live hash too)
+    STACK_VERIFY_SAMPLED = 3  //cheap checks, full check every every_n_ops ops and/or every_ms ms
+};
+
+struct StackVerifyPolicy{
+    stackVerifyLevel_t level;
+    unsigned int every_n_ops; //0 = not used
+    unsigned int every_ms;    //0 = not used
+};
+
+//used by stackCtor, can be changed with stackSetDefaultVerifyPolicy
+inline StackVerifyPolicy stack_default_verify_policy = {STACK_VERIFY_FULL, 0, 0};
+
+//which slots stackDump shows. Skipped ranges are shown as one line
+struct StackDumpOptions{
+    size_t head;            //first slots, SIZE_MAX for all
+    size_t tail;            //slots just below the top (size)
+    size_t context;         //slots on both sides of the first corrupted slot (not poison above the top), 0 = off
+    bool   corruption_only; //if a corrupted slot is found, show only slots around it
+    bool   compress_poison; //runs of poison are shown as one line
+    size_t data_bytes;      //raw bytes shown when data pointer is invalid
+    bool   stats;           //counters, if stack policy has them
+};
+
+inline const StackDumpOptions stack_dump_all = {SIZE_MAX, 0, 0, false, false, SIZE_MAX, true};
+
+//used by stackDump, can be changed with stackSetDefaultDumpOptions
+inline StackDumpOptions stack_default_dump_options = {32, 32, 16, false, true, 256, true};
+
+//fields written by every op come first, they share a cache line with the rest of the op state
+struct StackStats{
+    size_t pushes;        //elements, bulk ops count each one
+    size_t pops;
+    size_t high_water;    //largest size reached
+
+    //stats_time only: time in stackError run by op checks and in hash updates after ops
+    uint64_t error_ns;
+    uint64_t hash_ns;
+
+    size_t grows;
+    size_t shrinks;
+    size_t realloc_bytes; //sizes of data buffers (re)allocated by resizes
+
+    //times an op reported each stackError_t bit, by bit number
+    uint32_t errors[STACK_ERROR_BITS];
+
+    //concurrent stack only: ops that went through the shared top and ops cancelled out in elimination array
+    size_t central;
+    size_t eliminated;
+};
+
+//writes stats as one log message, in stackDump format
+inline void stackPrintStats(const StackStats* stats){
+    if (!LOG_ENABLED(LOG_LEVEL_INFO))
+        return;
+    LogTextBuf buf = {};
+    logBufPrintf(&buf, "      Stats: %zu pushes, %zu pops, high water %zu\n",
+                 stats->pushes, stats->pops, stats->high_water);
+    logBufPrintf(&buf, "             %zu grows, %zu shrinks, %zu bytes reallocated\n",
+                 stats->grows, stats->shrinks, stats->realloc_bytes);
+    if (stats->error_ns != 0 || stats->hash_ns != 0)
+        logBufPrintf(&buf, "             %llu ns in checks, %llu ns in hash updates\n",
+                     (unsigned long long)stats->error_ns, (unsigned long long)stats->hash_ns);
+    if (stats->central != 0 || stats->eliminated != 0)
+        logBufPrintf(&buf, "             %zu central ops, %zu eliminated\n", stats->central, stats->eliminated);
+    for (int bit = 0; bit < STACK_ERROR_BITS; bit++){
+        if (stats->errors[bit] != 0)
+            logBufPrintf(&buf, "             %s x %u\n", stackErrorName(bit), stats->errors[bit]);
+    }
+    logBufFlush(&buf);
+    logBufFree (&buf);
+}
+
+//stats as a JSON object into buf, snprintf style: returns length of the whole object,
+//buf holds a terminated prefix of it if size is too small
+inline size_t stackStatsJson(const StackStats* stats, char* buf, size_t size){
+    size_t len = 0;
+    auto add = [&](const char* format, auto... args){
+        size_t left = (len < size)? size - len : 0;
+        int written = snprintf((left != 0)? buf + len : nullptr, left, format, args...);
+        if (written > 0)
+            len += written;
+    };
+    add("{\"pushes\":%zu,\"pops\":%zu,\"grows\":%zu,\"shrinks\":%zu,\"realloc_bytes\":%zu,\"high_water\":%zu,",
+        stats->pushes, stats->pops, stats->grows, stats->shrinks, stats->realloc_bytes, stats->high_water);
+    add("\"error_ns\":%llu,\"hash_ns\":%llu,\"central\":%zu,\"eliminated\":%zu,\"errors\":{",
+        (unsigned long long)stats->error_ns, (unsigned long long)stats->hash_ns, stats->central, stats->eliminated);
+    const char* separator = "";
+    for (int bit = 0; bit < STACK_ERROR_BITS; bit++){
+        if (stats->errors[bit] != 0){
+            add("%s\"%s\":%u", separator, stackErrorName(bit), stats->errors[bit]);
+            separator = ",";
+        }
+    }
+    add("}}");
+    return len;
+}
+
+//seqlock shared with the background verifier (see StackVerifier.h)
+//version is odd while stack is being modified
+//low is the lowest element slot written since the verifier last took it, 0 after a realloc
+//buf_mutex is held while data buffer is reallocated or freed
+struct StackSeq{
+    std::atomic<uint64_t> version;
+    std::atomic<size_t>   low;
+    std::mutex buf_mutex;
+};
+
+//cache line size assumed for alignment
+static const size_t STACK_CACHE_LINE = 64;
+
+//data buffer inside the stack struct, same layout as a heap one (data canaries around elements)
+template<size_t bytes, size_t align>
+struct StackInlineBuf{
+    alignas(align) char mem[bytes];
+};
+
+//alignment of the stack struct: policy align, but never less than its largest member needs
+template<typename elem_t, class policy_t>
+constexpr size_t stackStructAlign(){
+    size_t natural = (alignof(uint64_t) > alignof(void*))? alignof(uint64_t) : alignof(void*);
+    if (policy_t::inline_size != 0 && alignof(elem_t) > natural)
+        natural = alignof(elem_t);
+    return (policy_t::align > natural)? policy_t::align : natural;
+}
+
+//field that exists only if enabled, takes no space otherwise
+template<int tag>
+struct StackNoField{};
+template<bool enabled, typename field_t, int tag>
+using StackField = typename std::conditional<enabled, field_t, StackNoField<tag>>::type;
+
+template<typename elem_t, class policy_t = StackPolicyFull, class traits_t = StackElemTraits<elem_t>>
+struct alignas(stackStructAlign<elem_t, policy_t>()) StackT{
+    typedef elem_t   elem_type;
+    typedef policy_t policy_type;
+    typedef traits_t traits_type;
+
+    static constexpr bool   protect     = policy_t::protect;
+    static constexpr bool   canary      = protect && policy_t::canary;
+    static constexpr bool   hash        = protect && policy_t::hash;
+    static constexpr bool   hash_live   = hash    && policy_t::hash_live;
+    static constexpr bool   poison      = protect && policy_t::poison;
+    static constexpr bool   bg_verifier = policy_t::bg_verifier;
+    static constexpr bool   stats       = policy_t::stats;
+    static constexpr bool   stats_time  = stats   && policy_t::stats_time;
+    static constexpr bool   guard_pages = protect && policy_t::guard_pages;
+    static constexpr bool   data_lcanary = canary;                 //guard block slack before data is not guarded
+    static constexpr bool   data_rcanary = canary && !guard_pages; //data ends right at the upper guard page
+    static constexpr bool   trivial     = std::is_trivially_copyable_v<elem_t>; //copied with memcpy, never destroyed
+    static constexpr bool   relocatable = StackRelocatable<elem_t>::value;      //moved with memcpy and realloc
+    static constexpr size_t min_size    = policy_t::min_size;
+    static constexpr size_t inline_size = policy_t::inline_size;
+    static constexpr size_t growth_num  = policy_t::growth_num;
+    static constexpr size_t growth_den  = policy_t::growth_den;
+    static constexpr size_t shrink_div  = policy_t::shrink_div;
+    static constexpr size_t shrink_mul  = policy_t::shrink_mul;
+
+    static_assert(growth_num > growth_den, "stack growth factor must be > 1");
+    static_assert(shrink_div == 0 || shrink_div >= shrink_mul, "stack would grow when shrinking");
+    static_assert(!guard_pages || stack_guard_pages_supported, "guard pages are not supported on this platform");
+    static_assert(!guard_pages || inline_size == 0, "guard pages need the whole data buffer on the heap");
+    static_assert((policy_t::align & (policy_t::align - 1)) == 0, "stack alignment must be a power of 2");
+
+    //data follows left canary and is aligned for elem_t, right canary goes right after the elements
+    static constexpr size_t data_begin_offset = !data_lcanary                       ? 0 :
+                                                (alignof(elem_t) > sizeof(canary_t))? alignof(elem_t) : sizeof(canary_t);
+    static constexpr size_t data_size_offset  = data_begin_offset + (data_rcanary ? sizeof(canary_t) : 0);
+    static constexpr size_t inline_align      = (alignof(elem_t) > alignof(canary_t))? alignof(elem_t) : alignof(canary_t);
+
+    //hot: read by every op, 64 bytes with everything on, so one cache line when the struct is
+    //aligned to STACK_CACHE_LINE. Struct hash covers [data, verify_ops), which has no padding
+    [[no_unique_address]] StackField<canary , canary_t, 0> leftcan;
+
+    elem_t *data;
+    size_t size;
+    size_t capacity;
+
+    [[no_unique_address]] StackField<hash   , hash_t           , 3> data_hash;
+    [[no_unique_address]] StackField<protect, StackVerifyPolicy, 2> verify;
+    //sampling counter, changes on every sampled op so it is not covered by struct hash
+    [[no_unique_address]] StackField<protect, unsigned int     , 5> verify_ops;
+    [[no_unique_address]] StackField<hash   , hash_t           , 4> struct_hash;
+
+    //written by ops: sampling clock, verifier seqlock and counters (StackStats starts with per-op ones)
+    [[no_unique_address]] StackField<protect, uint64_t         , 6> verify_last_ms;
+    //nullptr unless registered in a StackVerifier
+    [[no_unique_address]] StackField<bg_verifier, StackSeq*    , 7> seq;
+    [[no_unique_address]] StackField<stats  , StackStats       , 9> stats_data;
+
+    //cold: touched by resizes, full checks and dumps
+    const StackAllocator* allocator; //data buffer allocator, see stackSetAllocator
+    [[no_unique_address]] StackField<hash   , hash_t           ,11> alloc_hash;
+    [[no_unique_address]] StackField<protect, VarInfo          , 1> info;
+
+    //data is here while capacity is inline_size
+    [[no_unique_address]] StackField<inline_size != 0, StackInlineBuf<inline_size*sizeof(elem_t) + data_size_offset,
+                                                                      inline_align>, 10> inline_buf;
+
+    //checked by full checks only, cheap ones read just the left canary
+    [[no_unique_address]] StackField<canary , canary_t, 8> rightcan;
+};
+
+#ifdef STACK_TEMPLATE
+    #error redefinition of internal macro STACK_TEMPLATE
+#endif
+#define STACK_TEMPLATE template<typename elem_t, class policy_t, class traits_t>
+#ifdef STACK_T
+    #error redefinition of internal macro STACK_T
 #endif
+#define STACK_T StackT<elem_t, policy_t, traits_t>
+
+//value of data pointer after stackDtor
+template<typename elem_t>
+inline elem_t* stackDestructPtr(){
+    return (elem_t*)0xBAD;
+}
 
 #ifdef stackCheckRet
     #error redefinition of internal macro stackCheckRet
 #endif
-#ifndef STACK_NO_PROTECT
-    #define stackCheckRet(__stk, ...)  \
-        if(stackError(__stk)){             \
-            error_log("%s", "Stack error");\
-            stackDump(__stk);              \
-            return __VA_ARGS__;            \
-        }
-#else
-    #define stackCheckRet(__stk, ...) ;
-#endif
+//returns the error found by the check, a later check may not see it (sampled levels)
+#define stackCheckRet(__stk)                    \
+    if(stackError_t __err = stackCheck(__stk)){ \
+        error_log("%s", "Stack error");   \
+        stackDump(__stk);                 \
+        return __err;                     \
+    }
 
 #ifdef stackCheckRetPtr
     #error redefinition of internal macro stackCheckRetPtr
 #endif
-#ifndef STACK_NO_PROTECT
-    #define stackCheckRetPtr(__stk, __errptr, ...)  \
-        if(stackError(__stk)){                \
-            error_log("%s", "Stack error");   \
-            stackDump(__stk);                 \
-            if(__errptr)                      \
-                *__errptr = stackError(__stk);\
-            return __VA_ARGS__;               \
-        }
-#else
-    #define stackCheckRetPtr(__stk, __errptr, ...)  ;
-#endif
-
-struct Stack{
-    #ifndef STACK_NO_CANARY
-        canary_t leftcan;
-    #endif
-
-    ELEM_T *data;
-    size_t size;
-    size_t capacity;
+#define stackCheckRetPtr(__stk, __errptr, ...)  \
+    if(stackError_t __err = stackCheck(__stk)){ \
+        error_log("%s", "Stack error");   \
+        stackDump(__stk);                 \
+        if(__errptr)                      \
+            *__errptr = __err;            \
+        return __VA_ARGS__;               \
+    }
 
-    #ifndef STACK_NO_PROTECT
-        VarInfo info;
-    #endif
-    #ifndef STACK_NO_HASH
-        hash_t data_hash;
-        hash_t struct_hash;
-    #endif
-    #ifndef STACK_NO_CANARY
-        canary_t rightcan;
-    #endif
+template<class stack_t, bool enabled = stack_t::bg_verifier>
+struct StackSeqWriteGuard{
+    StackSeqWriteGuard(const stack_t*){}
+};
+template<class stack_t>
+struct StackSeqWriteGuard<stack_t, true>{
+    const stack_t* stk;
+    StackSeq*      seq;
+    const void*    data     = nullptr;
+    size_t         size     = 0;
+    size_t         capacity = 0;
+    StackSeqWriteGuard(const stack_t* stk): stk(stk), seq(stk->seq){
+        if (seq){
+            data     = stk->data;
+            size     = stk->size;
+            capacity = stk->capacity;
+            seq->version.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+    }
+    ~StackSeqWriteGuard(){
+        if (!seq)
+            return;
+        //ops write only slots above the lower of old and new size, unless buffer was replaced
+        size_t low = (stk->size < size)? stk->size : size;
+        if (stk->data != data || stk->capacity != capacity)
+            low = 0;
+        if (low < seq->low.load(std::memory_order_relaxed))
+            seq->low.store(low, std::memory_order_relaxed);
+        seq->version.fetch_add(1, std::memory_order_release);
+    }
 };
 
-#ifndef STACK_NO_CANARY
-    static const size_t STACK_DATA_BEGIN_OFFSET  =   sizeof(canary_t);
-    static const size_t STACK_DATA_SIZE_OFFSET   = 2*sizeof(canary_t);
-#else
-    static const size_t STACK_DATA_BEGIN_OFFSET  = 0;
-    static const size_t STACK_DATA_SIZE_OFFSET   = 0;
+#ifdef stackSeqWrite
+    #error redefinition of internal macro stackSeqWrite
+#endif
+//marks the rest of the scope as a write section for the verifier
+#define stackSeqWrite(__stk) \
+    StackSeqWriteGuard<typename std::remove_pointer<decltype(__stk)>::type> __seq_write_guard(__stk)
+
+STACK_TEMPLATE
+inline std::unique_lock<std::mutex> stackBufLock_(const STACK_T* stk){
+    if constexpr (STACK_T::bg_verifier){
+        if (stk->seq)
+            return std::unique_lock<std::mutex>(stk->seq->buf_mutex);
+    }
+    return std::unique_lock<std::mutex>();
+}
+#ifdef stackBufLock
+    #error redefinition of internal macro stackBufLock
 #endif
-inline static void* stackDataMemBegin(const Stack* stk){
+//keeps the data buffer alive while the verifier copies it
+#define stackBufLock(__stk) \
+    std::unique_lock<std::mutex> __buf_lock = stackBufLock_(__stk)
+
+STACK_TEMPLATE
+inline void* stackDataMemBegin(const STACK_T* stk){
     assert_log(stk != nullptr);
-    return ((uint8_t*)stk->data)-STACK_DATA_BEGIN_OFFSET;
+    return ((uint8_t*)stk->data)-STACK_T::data_begin_offset;
 }
-inline static size_t stackDataMemSize(const Stack* stk){
+STACK_TEMPLATE
+inline size_t stackDataMemSize(const STACK_T* stk){
     assert_log(stk != nullptr);
-    return (stk->capacity*sizeof(ELEM_T)) + STACK_DATA_SIZE_OFFSET ;
+    return (stk->capacity*sizeof(elem_t)) + STACK_T::data_size_offset;
+}
+
+//data of the inline buffer, nullptr if policy has none
+STACK_TEMPLATE
+inline typename STACK_T::elem_type* stackInlineData(const STACK_T* stk){
+    if constexpr (STACK_T::inline_size != 0)
+        return (elem_t*)(stk->inline_buf.mem + STACK_T::data_begin_offset);
+    else
+        return nullptr;
+}
+
+STACK_TEMPLATE
+inline bool stackDataInline(const STACK_T* stk){
+    if constexpr (STACK_T::inline_size != 0)
+        return stk->data == stackInlineData(stk);
+    else
+        return false;
+}
+
+//unused slots [from, to): poison value, or poison bytes if elements are not trivially copyable
+STACK_TEMPLATE
+inline void stackPoisonSlots(STACK_T* stk, size_t from, size_t to){
+    if constexpr (STACK_T::poison){
+        if constexpr (STACK_T::trivial){
+            for (size_t i = from; i < to; i++)
+                stk->data[i] = traits_t::poison();
+        }
+        else if (from < to){
+            memset((void*)(stk->data + from), STACK_POISON_BYTE, (to - from) * sizeof(elem_t));
+        }
+    }
+}
+
+//runs destructors of elements in [from, to)
+STACK_TEMPLATE
+inline void stackDestroySlots(STACK_T* stk, size_t from, size_t to){
+    if constexpr (!std::is_trivially_destructible_v<elem_t>){
+        for (size_t i = from; i < to; i++)
+            stk->data[i].~elem_t();
+    }
+}
+
+//moves n elements to uninitialised slots at dst, slots at src are left destroyed
+STACK_TEMPLATE
+void stackRelocate(const STACK_T*, typename STACK_T::elem_type* dst, typename STACK_T::elem_type* src, size_t n){
+    if constexpr (STACK_T::relocatable){
+        memcpy((void*)dst, (const void*)src, n * sizeof(elem_t));
+    }
+    else{
+        for (size_t i = 0; i < n; i++){
+            new (dst + i) elem_t(std::move(src[i]));
+            src[i].~elem_t();
+        }
+    }
+}
+
+//data canaries for current capacity, poison in slots [from, capacity)
+STACK_TEMPLATE
+void stackInitBuf(STACK_T* stk, size_t from){
+    if constexpr (STACK_T::data_rcanary)
+        setRCanary(stk->data, stk->capacity * sizeof(elem_t));
+    if constexpr (STACK_T::data_lcanary)
+        setLCanary(stk->data);
+    stackPoisonSlots(stk, from, stk->capacity);
 }
 
 
 
-#ifndef STACK_NO_HASH
-    static hash_t stackGetDataHash(const Stack* stk){
-        return gnuHash(stk->data, stk->data + stk->capacity);
+STACK_TEMPLATE
+hash_t stackHashData(const STACK_T*, const typename STACK_T::elem_type* begin, const typename STACK_T::elem_type* end){
+    if constexpr (STACK_T::hash_live){
+        //live hash is updated incrementally, so it is always polynomial whatever kernel is selected
+        return gnuHashFast(begin, end);
     }
-    static hash_t stackGetStructHash(const Stack* stk){
-        return gnuHash(&(stk->data), &(stk->struct_hash));
+    else{
+        return dataHash(begin, end);
     }
+}
+
+//continues stackHashData over raw bytes of elements
+STACK_TEMPLATE
+hash_t stackHashDataAppend(const STACK_T*, hash_t hash, const void* begin, const void* end){
+    if constexpr (STACK_T::hash_live)
+        return gnuHashAppendFast(hash, begin, end);
+    else
+        return dataHashAppend(hash, begin, end);
+}
+
+STACK_TEMPLATE
+hash_t stackGetDataHash(const STACK_T* stk){
+    if constexpr (STACK_T::hash_live)
+        return stackHashData(stk, stk->data, stk->data + stk->size);
+    else
+        return stackHashData(stk, stk->data, stk->data + stk->capacity);
+}
+
+STACK_TEMPLATE
+hash_t stackGetDataHashParallel(const STACK_T* stk, unsigned int threads){
+    if constexpr (STACK_T::hash_live)
+        return gnuHashParallel (stk->data, stk->data + stk->size    , threads);
+    else
+        return dataHashParallel(stk->data, stk->data + stk->capacity, threads);
+}
+
+//hot fields only, VarInfo, sampling state and stats are not protected
+STACK_TEMPLATE
+hash_t stackGetStructHash(const STACK_T* stk){
+    static_assert(STACK_T::hash, "stack policy has no hash");
+    static_assert(sizeof(StackVerifyPolicy) == sizeof(stackVerifyLevel_t) + 2*sizeof(unsigned int),
+                  "padding in verify policy would be hashed");
+    return gnuHashFast(&(stk->data), &(stk->verify_ops));
+}
+
+//allocator is cold, so it has its own hash, changed only with the allocator
+STACK_TEMPLATE
+hash_t stackGetAllocHash(const STACK_T* stk){
+    static_assert(STACK_T::hash, "stack policy has no hash");
+    return gnuHashFast(&(stk->allocator), &(stk->allocator) + 1);
+}
 
-    static stackError_t stackUpdHashes(Stack* stk){
+STACK_TEMPLATE
+void stackUpdStructHash(STACK_T* stk){
+    if constexpr (STACK_T::hash)
+        stk->struct_hash = stackGetStructHash(stk);
+}
+
+STACK_TEMPLATE
+void stackUpdAllocHash(STACK_T* stk){
+    if constexpr (STACK_T::hash)
+        stk->alloc_hash = stackGetAllocHash(stk);
+}
+
+STACK_TEMPLATE
+stackError_t stackUpdHashes(STACK_T* stk){
+    if constexpr (STACK_T::hash){
         if (stk == nullptr)
             return STACK_NULL;
-        if (IsBadWritePtr(stk, sizeof(stk)))
+        if (isBadWritePtr(stk, sizeof(*stk)))
             return STACK_BAD;
         if (stk->data == nullptr && stk->capacity != 0)
             return STACK_DATA_NULL;
-        if (stk->data == DESTRUCT_PTR)
+        if (stk->data == stackDestructPtr<elem_t>())
             return STACK_DATA_NULL;
         if (stk->size > stk->capacity)
             return STACK_SIZE_CAP_BAD;
 
         stk->data_hash   = stackGetDataHash  (stk);
         stk->struct_hash = stackGetStructHash(stk);
-
-        return STACK_NOERROR;
+        stk->alloc_hash  = stackGetAllocHash (stk);
     }
-#else
-    static stackError_t stackUpdHashes(Stack* stk){
-        return STACK_NOERROR;
+    return STACK_NOERROR;
+}
+
+//inverse of 33^sizeof(elem_t), removes one element from the end of a live hash
+template<typename elem_t>
+inline const hash_t stack_elem_hash_inv = gnuHashPowInv(sizeof(elem_t));
+
+//must be called after elem is placed on top
+STACK_TEMPLATE
+void stackHashPushElem(STACK_T* stk, const typename STACK_T::elem_type* elem){
+    if constexpr (STACK_T::hash_live)
+        stk->data_hash = gnuHashAppend(stk->data_hash, elem, elem + 1);
+}
+//must be called with the elem that was just removed from top
+STACK_TEMPLATE
+void stackHashPopElem(STACK_T* stk, const typename STACK_T::elem_type* elem){
+    if constexpr (STACK_T::hash_live)
+        stk->data_hash = (stk->data_hash - gnuHashAppend(0, elem, elem + 1)) * stack_elem_hash_inv<elem_t>;
+}
+
+//hashes to update after an operation that changed top element or capacity
+STACK_TEMPLATE
+void stackUpdHashesOp(STACK_T* stk){
+    if constexpr (STACK_T::hash){
+        uint64_t start = 0;
+        if constexpr (STACK_T::stats_time)
+            start = monotonicTimeNs();
+
+        if constexpr (STACK_T::hash_live)
+            stackUpdStructHash(stk);
+        else
+            stackUpdHashes(stk);
+
+        if constexpr (STACK_T::stats_time)
+            stk->stats_data.hash_ns += monotonicTimeNs() - start;
     }
-#endif
+}
 
-static bool stackCtor_(Stack* stk){
-    #ifndef STACK_NO_PROTECT
-    if (IsBadWritePtr(__stk, sizeof(__stk))){
-        return false;
+STACK_TEMPLATE
+bool stackCtor_(STACK_T* stk, VarInfo info){
+    if constexpr (STACK_T::protect){
+        if (isBadWritePtr(stk, sizeof(*stk))){
+            return false;
+        }
     }
-    #endif
     stk->data = nullptr;
     stk->size = 0;
     stk->capacity = 0;
+    stk->allocator = &stack_malloc_allocator;
+    if constexpr (STACK_T::guard_pages){
+        stk->allocator = &stack_guard_allocator;
+        stackGuardInstallHandler();
+    }
+    if constexpr (STACK_T::bg_verifier)
+        stk->seq = nullptr;
+    if constexpr (STACK_T::stats)
+        stk->stats_data = {};
+    if constexpr (STACK_T::inline_size != 0){
+        stk->data     = stackInlineData(stk);
+        stk->capacity = STACK_T::inline_size;
+        stackInitBuf(stk, 0);
+    }
 
-    #ifndef STACK_NO_CANARY
+    if constexpr (STACK_T::protect){
+        ptrTrack(stk, sizeof(*stk));
+        stk->info           = info;
+        stk->verify         = stack_default_verify_policy;
+        stk->verify_ops     = 0;
+        stk->verify_last_ms = monotonicTimeMs();
+    }
+
+    if constexpr (STACK_T::canary){
         stk->leftcan  = CANARY_L;
         stk->rightcan = CANARY_R;
-    #endif
+    }
+    stackUpdHashes(stk);
     return true;
 }
 #ifdef stackCtor
     #error redefinition of internal macro stackCtor
 #endif
-#ifndef STACK_NO_PROTECT
-    #define stackCtor(__stk)    \
-        if (stackCtor_(__stk);){  \
-            (__stk)->info = varInfoInit(__stk); \
-            stackUpdHashes(__stk);  \
-        }                       \
-        else {                  \
-            error_log("%s", "bad ptr passed to constructor\n");\
-        }
-#else
-    #define stackCtor(__stk)    \
-            stackCtor_(__stk);
-#endif
-static stackError_t stackError(const Stack* stk){
+#define stackCtor(__stk)                                        \
+    if (!stackCtor_(__stk, varInfoInit(__stk))){                \
+        error_log("%s", "bad ptr passed to constructor\n");     \
+    }
+
+//rescan_data = false skips data hash check (for callers that check it themselves)
+STACK_TEMPLATE
+stackError_t stackError(const STACK_T* stk, bool rescan_data = true){
     if (stk == nullptr)
         return STACK_NULL;
 
-    if (IsBadReadPtr(stk, sizeof(stk)))
+    if (isBadReadPtr(stk, sizeof(*stk)))
         return STACK_BAD;
 
-    if (stk->size == SIZE_MAX || stk->capacity == SIZE_MAX || stk->data == DESTRUCT_PTR)
+    if (stk->size == SIZE_MAX || stk->capacity == SIZE_MAX || stk->data == stackDestructPtr<elem_t>())
         return STACK_DEAD;
 
 
@@ -206,61 +764,360 @@ static stackError_t stackError(const Stack* stk){
     if (stk->capacity != 0){
         if (stk->data == nullptr)
             err |= STACK_DATA_NULL;
-        if (IsBadWritePtr(stackDataMemBegin(stk), stackDataMemSize(stk)))
+        //inline buffer is a part of *stk
+        if (!stackDataInline(stk) && isBadWritePtr(stackDataMemBegin(stk), stackDataMemSize(stk)))
             err |= STACK_DATA_BAD;
     }
     if (stk->size > stk->capacity)
         err |= STACK_SIZE_CAP_BAD;
 
-    #ifndef STACK_NO_CANARY
+    if constexpr (STACK_T::canary){
         if (stk->leftcan != CANARY_L)
             err |= STACK_CANARY_L_BAD;
         if (stk->rightcan != CANARY_R)
             err |= STACK_CANARY_R_BAD;
-    #endif
+    }
 
-    #ifndef STACK_NO_HASH
-        if (stk->struct_hash     != stackGetStructHash(stk))
+    if constexpr (STACK_T::hash){
+        if (stk->struct_hash != stackGetStructHash(stk) || stk->alloc_hash != stackGetAllocHash(stk))
             err |= STACK_HASH_BAD;
-    #endif
+    }
 
     if ((err & (STACK_DATA_BAD | STACK_HASH_BAD)) || stk->data == nullptr){
-        #ifndef STACK_NO_HASH
+        if constexpr (STACK_T::hash){
             if(stk->data_hash != HASH_DEFAULT)
                 err |= STACK_DATA_HASH_BAD;
-        #endif
+        }
         return (stackError_t)err;
     }
 
-    #ifndef STACK_NO_CANARY
+    if constexpr (STACK_T::data_lcanary){
         if (!checkLCanary(stk->data))
             err |= STACK_DATA_CANARY_L_BAD;
-        if (!checkRCanary(stk->data, stk->capacity * sizeof(ELEM_T)))
+    }
+    if constexpr (STACK_T::data_rcanary){
+        if (!checkRCanary(stk->data, stk->capacity * sizeof(elem_t)))
             err |= STACK_DATA_CANARY_R_BAD;
-    #endif
+    }
 
-    #ifndef STACK_NO_HASH
-        if (stk->data_hash   != stackGetDataHash(stk))
+    if constexpr (STACK_T::hash && !STACK_T::hash_live){
+        if (rescan_data && stk->data_hash != stackGetDataHash(stk))
             err |= STACK_DATA_HASH_BAD;
-    #endif
+    }
 
     return (stackError_t)err;
 }
 
-inline static stackError_t stackError_dbg(Stack* stk){
-    #ifndef STACK_NO_PROTECT
-        return stackError(stk);
-    #else
+//full check, rescans data even if hash_live is on
+STACK_TEMPLATE
+stackError_t stackVerifyData(const STACK_T* stk){
+    int err = stackError(stk);
+    if constexpr (STACK_T::hash_live){
+        if (err & (STACK_NULL | STACK_BAD | STACK_DEAD | STACK_DATA_BAD))
+            return (stackError_t)err;
+        if (stk->data != nullptr && stk->data_hash != stackGetDataHash(stk))
+            err |= STACK_DATA_HASH_BAD;
+    }
+    return (stackError_t)err;
+}
+
+//full check with data hash computed on several threads (0 = all hardware threads), for huge stacks
+STACK_TEMPLATE
+stackError_t stackVerifyDataParallel(const STACK_T* stk, unsigned int threads){
+    int err = stackError(stk, false);
+    if constexpr (STACK_T::hash){
+        if (err & (STACK_NULL | STACK_BAD | STACK_DEAD | STACK_DATA_BAD | STACK_DATA_HASH_BAD))
+            return (stackError_t)err;
+        if (stk->data != nullptr && stk->data_hash != stackGetDataHashParallel(stk, threads))
+            err |= STACK_DATA_HASH_BAD;
+    }
+    return (stackError_t)err;
+}
+
+//O(1) subset of stackError: no pointer probes and no hashing. Reads only the hot fields,
+//so the right struct canary is left to full checks
+STACK_TEMPLATE
+stackError_t stackErrorCheap(const STACK_T* stk){
+    if (stk == nullptr)
+        return STACK_NULL;
+
+    if (stk->size == SIZE_MAX || stk->capacity == SIZE_MAX || stk->data == stackDestructPtr<elem_t>())
+        return STACK_DEAD;
+
+    unsigned int err = 0;
+
+    if (stk->capacity != 0 && stk->data == nullptr)
+        err |= STACK_DATA_NULL;
+    if (stk->size > stk->capacity)
+        err |= STACK_SIZE_CAP_BAD;
+
+    if constexpr (STACK_T::canary){
+        if (stk->leftcan != CANARY_L)
+            err |= STACK_CANARY_L_BAD;
+
+        if (stk->data != nullptr && !(err & (STACK_DATA_NULL | STACK_CANARY_L_BAD))){
+            if constexpr (STACK_T::data_lcanary){
+                if (!checkLCanary(stk->data))
+                    err |= STACK_DATA_CANARY_L_BAD;
+            }
+            if constexpr (STACK_T::data_rcanary){
+                if (!checkRCanary(stk->data, stk->capacity * sizeof(elem_t)))
+                    err |= STACK_DATA_CANARY_R_BAD;
+            }
+        }
+    }
+
+    return (stackError_t)err;
+}
+
+//counts error bits reported by an op, returns err
+STACK_TEMPLATE
+inline stackError_t stackCountError(STACK_T* stk, stackError_t err){
+    if constexpr (STACK_T::stats){
+        //no stats to write to
+        if (err == STACK_NOERROR || (err & (STACK_NULL | STACK_BAD)))
+            return err;
+        for (int bit = 0; bit < STACK_ERROR_BITS; bit++){
+            if (err & (1u << bit))
+                stk->stats_data.errors[bit]++;
+        }
+    }
+    return err;
+}
+
+//stackError run on op path. full also rescans a live data hash, so full and sampled
+//checks catch corruption below the top
+STACK_TEMPLATE
+stackError_t stackErrorOp(STACK_T* stk, bool full = true){
+    uint64_t start = 0;
+    if constexpr (STACK_T::stats_time)
+        start = monotonicTimeNs();
+
+    stackError_t err = (full)? stackVerifyData(stk) : stackError(stk);
+
+    if constexpr (STACK_T::stats_time){
+        if (!(err & (STACK_NULL | STACK_BAD)))
+            stk->stats_data.error_ns += monotonicTimeNs() - start;
+    }
+    return err;
+}
+
+//counters for elements pushed or popped by an op, called after size is changed
+STACK_TEMPLATE
+inline void stackStatsOp(STACK_T* stk, size_t pushed, size_t popped){
+    if constexpr (STACK_T::stats){
+        stk->stats_data.pushes += pushed;
+        stk->stats_data.pops   += popped;
+        if (stk->size > stk->stats_data.high_water)
+            stk->stats_data.high_water = stk->size;
+    }
+}
+
+//advances sampling state of a sampled verify policy, true if full check is due
+inline bool stackVerifyPolicyDue(const StackVerifyPolicy* verify, unsigned int* ops, uint64_t* last_ms){
+    bool due = false;
+    if (verify->every_n_ops != 0 && ++*ops >= verify->every_n_ops){
+        *ops = 0;
+        due = true;
+    }
+    if (verify->every_ms != 0){
+        uint64_t now = monotonicTimeMs();
+        if (now - *last_ms >= verify->every_ms){
+            *last_ms = now;
+            due = true;
+        }
+    }
+    return due;
+}
+
+STACK_TEMPLATE
+bool stackVerifyDue(STACK_T* stk){
+    return stackVerifyPolicyDue(&(stk->verify), &(stk->verify_ops), &(stk->verify_last_ms));
+}
+
+//check done before each operation, according to stack verify policy
+STACK_TEMPLATE
+stackError_t stackCheck(STACK_T* stk){
+    if constexpr (STACK_T::protect){
+        if (stk == nullptr)
+            return STACK_NULL;
+
+        stackError_t err = STACK_NOERROR;
+        switch (stk->verify.level){
+        case STACK_VERIFY_OFF:
+            break;
+        case STACK_VERIFY_CHEAP:
+            err = stackErrorCheap(stk);
+            break;
+        case STACK_VERIFY_FULL:
+            err = stackErrorOp(stk);
+            break;
+        case STACK_VERIFY_SAMPLED:
+            err = stackErrorCheap(stk);
+            if (err == STACK_NOERROR && stackVerifyDue(stk))
+                err = stackErrorOp(stk);
+            break;
+        default: //policy itself is corrupted
+            err = stackErrorOp(stk);
+            break;
+        }
+        return stackCountError(stk, err);
+    }
+    else{
         return STACK_NOERROR;
-    #endif
+    }
+}
+
+//check done after operations, does not advance sampling. Bits in ignore are not reported
+STACK_TEMPLATE
+inline stackError_t stackError_dbg(STACK_T* stk, unsigned int ignore = 0){
+    if constexpr (STACK_T::protect){
+        if (stk == nullptr)
+            return STACK_NULL;
+
+        stackError_t err = STACK_NOERROR;
+        switch (stk->verify.level){
+        case STACK_VERIFY_OFF:
+            break;
+        case STACK_VERIFY_CHEAP:
+        case STACK_VERIFY_SAMPLED:
+            err = stackErrorCheap(stk);
+            break;
+        default: //data was checked before the op, live hash was updated by it
+            err = stackErrorOp(stk, false);
+            break;
+        }
+        return stackCountError(stk, (stackError_t)(err & ~ignore));
+    }
+    else{
+        return STACK_NOERROR;
+    }
+}
+
+
+
+template<typename elem_t, typename traits_t>
+void stackDumpElem(LogTextBuf* buf, const elem_t& elem){
+    if constexpr (StackElemSpec<traits_t>::has){
+        logBufPrintf(buf, traits_t::spec, elem);
+    }
+    else if constexpr (std::is_same_v<traits_t, StackElemTraits<elem_t>>){
+        for (size_t i = 0; i < sizeof(elem); i++)
+            logBufPrintf(buf, "%02x", ((const uint8_t*)&elem)[i]);
+    }
+    else{
+        logBufFlush(buf);
+        traits_t::print(elem);
+    }
+}
+
+//slots [begin, end), text rows or one raw block in binary mode
+STACK_TEMPLATE
+void stackDumpSlots(const STACK_T* stk, size_t begin, size_t end, bool compress_poison, LogTextBuf* buf){
+    if (LOG_BINARY_ON){
+        static const uint32_t spec_id = logFormatId_(false, nullptr, StackElemSpec<traits_t>::value, nullptr, 0, nullptr);
+        logBufFlush(buf);
+        uint8_t poison[sizeof(elem_t)];
+        if constexpr (STACK_T::trivial){
+            elem_t value = traits_t::poison();
+            memcpy(poison, (const void*)&value, sizeof(elem_t));
+        }
+        else{
+            memset(poison, STACK_POISON_BYTE, sizeof(elem_t));
+        }
+        logBinaryElems_(spec_id, stk->data, sizeof(elem_t), stk->size, begin, end - begin, poison, compress_poison);
+        return;
+    }
+
+    for (size_t i = begin; i < end; i++){
+        char in_use = (i < stk->size)? '*' : ' ';
+        if (compress_poison && traits_t::isPoison(stk->data[i])){
+            size_t run_end = i + 1;
+            while (run_end < end && (run_end < stk->size) == (i < stk->size) && traits_t::isPoison(stk->data[run_end]))
+                run_end++;
+            if (run_end - i >= 2){
+                logBufPrintf(buf, "    %c[%zu..%zu] POISON x %zu\n", in_use, i, run_end - 1, run_end - i);
+                i = run_end - 1;
+                continue;
+            }
+        }
+        logBufPrintf(buf, "    %c[%zu] ", in_use, i);
+        stackDumpElem<elem_t, traits_t>(buf, stk->data[i]);
+        logBufPrintf(buf, "%s", (traits_t::isPoison(stk->data[i])) ? " (POISON)\n":" \n");
+    }
 }
 
+//head, tail and corruption windows merged, everything written with one log call
+STACK_TEMPLATE
+void stackDumpData(const STACK_T* stk, const StackDumpOptions* opt){
+    size_t capacity  = stk->capacity;
+    size_t first_bad = SIZE_MAX;
+    if constexpr (STACK_T::poison){
+        for (size_t i = stk->size; i < capacity; i++){
+            if (!traits_t::isPoison(stk->data[i])){
+                first_bad = i;
+                break;
+            }
+        }
+    }
+
+    struct Range{
+        size_t begin;
+        size_t end;
+    };
+    Range ranges[3] = {};
+    int   count     = 0;
+    auto addRange = [&](size_t begin, size_t end){
+        if (end > capacity)
+            end = capacity;
+        if (begin < end)
+            ranges[count++] = {begin, end};
+    };
+
+    bool bad_found = (first_bad != SIZE_MAX && opt->context > 0);
+    if (!(bad_found && opt->corruption_only)){
+        addRange(0, opt->head);
+        addRange((stk->size > opt->tail)? stk->size - opt->tail : 0, stk->size);
+    }
+    if (bad_found)
+        addRange((first_bad > opt->context)? first_bad - opt->context : 0, first_bad + opt->context + 1);
+
+    for (int i = 1; i < count; i++){
+        for (int j = i; j > 0 && ranges[j].begin < ranges[j - 1].begin; j--)
+            std::swap(ranges[j], ranges[j - 1]);
+    }
+
+    LogTextBuf buf = {};
+    if (first_bad != SIZE_MAX)
+        logBufPrintf(&buf, "      (BAD)  Slot %zu above the top is not poison\n", first_bad);
+
+    size_t shown = 0;
+    for (int i = 0; i < count; i++){
+        size_t begin = (ranges[i].begin > shown)? ranges[i].begin : shown;
+        if (begin >= ranges[i].end)
+            continue;
+        if (begin > shown)
+            logBufPrintf(&buf, "    ... %zu slots skipped\n", begin - shown);
+        stackDumpSlots(stk, begin, ranges[i].end, opt->compress_poison, &buf);
+        shown = ranges[i].end;
+    }
+    if (shown < capacity)
+        logBufPrintf(&buf, "    ... %zu slots skipped\n", capacity - shown);
+    logBufPrintf(&buf, "\n");
+
+    logBufFlush(&buf);
+    logBufFree (&buf);
+}
 
-static void stackDump(const Stack* stk){
+STACK_TEMPLATE
+void stackDump(const STACK_T* stk, const StackDumpOptions* opt){
+    //continuation lines are written with printf_log, which does not filter by level
+    if (!LOG_ENABLED(LOG_LEVEL_INFO))
+        return;
 
     info_log("Stack dump:\n      stack at %p \n", stk);
 
-    stackError_t err = stackError(stk);
+    stackError_t err = stackVerifyData(stk);
     if (err & STACK_NULL){
         printf_log("      (BAD)  Stack poiner is null\n");
         return;
@@ -271,30 +1128,35 @@ static void stackDump(const Stack* stk){
     }
 
     printf_log("      %ld/%ld elements\n", stk->size, stk->capacity);
-    printf_log("      Data: %p\n", stk->data);
+    printf_log("      Data: %p%s\n", stk->data, stackDataInline(stk)? " (inline)" : "");
 
     if (err & STACK_DEAD){
         printf_log("      (BAD)  Stack was already destructed\n\n");
         return;
     }
 
-    #ifndef STACK_NO_PROTECT
-    printVarInfo_log(&(stk->info));
-    #endif
+    if constexpr (STACK_T::protect)
+        printVarInfo_log(&(stk->info));
+
+    if constexpr (STACK_T::stats){
+        if (opt->stats)
+            stackPrintStats(&(stk->stats_data));
+    }
 
-    #ifndef STACK_NO_HASH
+    if constexpr (STACK_T::hash){
         if (err & STACK_HASH_BAD){
             printf_log("      (BAD)  Struct hash invalid. Written %p calculated %p\n", stk->struct_hash  , stackGetStructHash(stk));
+            printf_log("             Allocator hash:     written %p calculated %p\n", stk->alloc_hash   , stackGetAllocHash (stk));
         }
-    #endif
-    #ifndef STACK_NO_CANARY
+    }
+    if constexpr (STACK_T::canary){
         if (err & STACK_CANARY_L_BAD){
             printf_log("      (BAD)  Struct L canary BAD! Value: %p\n", stk->leftcan);
         }
         if (err & STACK_CANARY_R_BAD){
             printf_log("      (BAD)  Struct R canary BAD! Value: %p\n", stk->rightcan);
         }
-    #endif
+    }
 
     if (stk->data == nullptr){
         printf_log("      (bad?) Stack data poiner is null\n\n");
@@ -303,168 +1165,560 @@ static void stackDump(const Stack* stk){
 
     if (err & STACK_DATA_BAD){
         printf_log("      (BAD)  Stack data poiner is invalid\n");
-        dumpData(stackDataMemBegin(stk), stackDataMemSize(stk));
+        dumpData(stackDataMemBegin(stk), stackDataMemSize(stk), opt->data_bytes);
         return;
     }
     if (err & STACK_SIZE_CAP_BAD){
         printf_log("      (BAD)  Stack size is larger than capacity\n");
     }
 
-    #ifndef STACK_NO_HASH
+    if constexpr (STACK_T::hash){
         hash_t data_hash = stackGetDataHash(stk);
         if (data_hash != stk->data_hash){
             printf_log("      (BAD)  Data hash invalid. Written %p calculated %p\n", stk->data_hash  , data_hash);
         }
-    #endif
-    #ifndef STACK_NO_CANARY
+    }
+    if constexpr (STACK_T::data_lcanary){
         if (!checkLCanary(stk->data)){
-            printf_log("      (BAD)  Data L canary BAD! Value: %p\n", ((canary_t*)stk->data)[-1]);
+            printf_log("      (BAD)  Data L canary BAD! Value: %p\n", getLCanary(stk->data));
         }
-        if (!checkRCanary(stk->data, stk->capacity * sizeof(ELEM_T))){
-            printf_log("      (BAD)  Data R canary BAD! Value: %p\n",*((canary_t*)stk->data + stk->capacity));
+    }
+    if constexpr (STACK_T::data_rcanary){
+        if (!checkRCanary(stk->data, stk->capacity * sizeof(elem_t))){
+            printf_log("      (BAD)  Data R canary BAD! Value: %p\n",getRCanary(stk->data, stk->capacity * sizeof(elem_t)));
         }
-    #endif
+    }
     printf_log("\n");
 
-    for (size_t i = 0; i < stk->capacity; i++){
-        printf_log("    ");
+    stackDumpData(stk, opt);
+}
+
+STACK_TEMPLATE
+void stackDump(const STACK_T* stk){
+    stackDump(stk, &stack_default_dump_options);
+}
 
-        printf_log("%c", (i < stk->size           ) ? '*':' ');
+inline void stackSetDefaultDumpOptions(const StackDumpOptions* opt){
+    stack_default_dump_options = *opt;
+}
 
-        printf_log("[%ld] " ELEM_SPEC " ", i, stk->data[i]);
-        printf_log("%s", (stk->data[i] == BAD_ELEM) ? "(POISON)\n":"\n");
+inline void stackSetDefaultVerifyPolicy(StackVerifyPolicy policy){
+    stack_default_verify_policy = policy;
+}
+
+STACK_TEMPLATE
+stackError_t stackSetVerifyPolicy(STACK_T* stk, StackVerifyPolicy policy){
+    if constexpr (STACK_T::protect){
+        stackCheckRet(stk);
+        stackSeqWrite(stk);
+        stk->verify     = policy;
+        stk->verify_ops = 0;
+        stackUpdStructHash(stk);
     }
-    printf_log("\n");
+    return STACK_NOERROR;
+}
 
+//allocator must outlive the stack. Can only be changed while stack has no heap data buffer
+STACK_TEMPLATE
+stackError_t stackSetAllocator(STACK_T* stk, const StackAllocator* allocator){
+    stackCheckRet(stk);
+    if (allocator == nullptr || (stk->data != nullptr && !stackDataInline(stk)))
+        return STACK_OP_INVALID;
+    stackSeqWrite(stk);
+    stk->allocator = allocator;
+    stackUpdAllocHash(stk);
+    return STACK_NOERROR;
 }
 
-static stackError_t stackDtor(Stack* stk){
-    stackCheckRet(stk, stackError_dbg(stk));
+STACK_TEMPLATE
+stackError_t stackDtor(STACK_T* stk){
+    stackCheckRet(stk);
+    if constexpr (STACK_T::hash_live){
+        if (stackVerifyData(stk)){
+            error_log("%s", "Stack data hash error");
+            stackDump(stk);
+            return stackVerifyData(stk);
+        }
+    }
+    stackSeqWrite(stk);
+    stackBufLock(stk);
 
-    for (size_t i = 0; i < stk->capacity; i++){
-        stk->data[i] = BAD_ELEM;
+    if (stk->data != nullptr){
+        stackDestroySlots(stk, 0, stk->size);
+        stackPoisonSlots (stk, 0, stk->capacity);
+    }
+    if (stk->data != nullptr && !stackDataInline(stk)){
+        if constexpr (STACK_T::protect)
+            ptrUntrack(stackDataMemBegin(stk));
+        stk->allocator->free(stk->allocator->ctx, stackDataMemBegin(stk), stackDataMemSize(stk));
     }
-    if (stk->data != nullptr)
-        free(stackDataMemBegin(stk));
+    if constexpr (STACK_T::protect)
+        ptrUntrack(stk);
 
-    stk->data = DESTRUCT_PTR;
+    stk->data = stackDestructPtr<elem_t>();
     stk->size = -1;
     stk->capacity = -1;
-    #ifndef STACK_NO_PROTECT
-    (stk->info).status = VARSTATUS_DEAD;
-    #endif
+    if constexpr (STACK_T::protect)
+        (stk->info).status = VARSTATUS_DEAD;
     return STACK_NOERROR;
 }
 
 
 
-static stackError_t stackResize_(Stack* stk, size_t new_capacity){
+//called from SIGSEGV handler when a guard page around stack data is accessed: only raw
+//async-signal-safe writes, stackDump is for the crash path (see stackGuardLastFault)
+STACK_TEMPLATE
+void stackGuardFault(const void* stk_ptr, const void* addr){
+    const STACK_T* stk = (const STACK_T*)stk_ptr;
+    logSignalWrite("[ERROR]Stack data overrun: guard page at ");
+    logSignalWriteNum((uintptr_t)addr, 16);
+    logSignalWrite(" accessed\n     Stack ");
+    logSignalWriteNum((uintptr_t)stk, 16);
+    if (stk == nullptr){
+        logSignalWrite("\n");
+        return;
+    }
+    if constexpr (STACK_T::protect){
+        if (stk->info.name != nullptr && stk->info.file != nullptr){
+            logSignalWrite(" \"");
+            logSignalWrite(stk->info.name);
+            logSignalWrite("\" created at ");
+            logSignalWrite(stk->info.file);
+            logSignalWrite(" :");
+            logSignalWriteNum(stk->info.line, 10);
+        }
+    }
+    logSignalWrite("\n     data ");
+    logSignalWriteNum((uintptr_t)stk->data, 16);
+    logSignalWrite(" size ");
+    logSignalWriteNum(stk->size, 10);
+    logSignalWrite(" capacity ");
+    logSignalWriteNum(stk->capacity, 10);
+    logSignalWrite("\n");
+}
+
+STACK_TEMPLATE
+stackError_t stackResize_(STACK_T* stk, size_t new_capacity){
 
-    int err = stackError_dbg(stk);
-    err &= ~(STACK_HASH_BAD | STACK_DATA_HASH_BAD);
+    //hashes are not updated yet in the middle of an op
+    stackError_t err = stackError_dbg(stk, STACK_HASH_BAD | STACK_DATA_HASH_BAD);
     if (err)
-        return (stackError_t)err;
+        return err;
 
 
     if (new_capacity < stk->size){
-        return STACK_OP_INVALID;
+        return stackCountError(stk, STACK_OP_INVALID);
+    }
+    //inline buffer is used whenever elements fit in it
+    if (new_capacity < STACK_T::inline_size)
+        new_capacity = STACK_T::inline_size;
+
+    stackBufLock(stk);
+    const StackAllocator* alloc = stk->allocator;
+    size_t old_capacity = stk->capacity;
+    size_t old_size     = (stk->data != nullptr)? stackDataMemSize(stk) : 0;
+    bool   was_inline   = stackDataInline(stk);
+    char*  old_mem      = (stk->data != nullptr && !was_inline)? (char*)stackDataMemBegin(stk) : nullptr;
+
+    if constexpr (STACK_T::inline_size != 0){
+        if (new_capacity == STACK_T::inline_size){
+            if (was_inline)
+                return STACK_NOERROR;
+            //back from heap
+            stackRelocate(stk, stackInlineData(stk), stk->data, stk->size);
+            if constexpr (STACK_T::protect)
+                ptrUntrack(old_mem);
+            alloc->free(alloc->ctx, old_mem, old_size);
+            if constexpr (STACK_T::stats)
+                stk->stats_data.shrinks++;
+
+            stk->data     = stackInlineData(stk);
+            stk->capacity = new_capacity;
+            stackInitBuf(stk, stk->size);
+            //moved objects may differ byte by byte
+            if constexpr (STACK_T::hash_live && !STACK_T::relocatable)
+                stk->data_hash = stackGetDataHash(stk);
+            return STACK_NOERROR;
+        }
     }
 
     errno = 0;
-    ELEM_T* new_mem = nullptr;
-    if (stk->data != nullptr){
-        new_mem = (ELEM_T*)(
-                            (char*)realloc(stackDataMemBegin(stk), new_capacity*sizeof(ELEM_T) + STACK_DATA_SIZE_OFFSET)
-                            + STACK_DATA_BEGIN_OFFSET);
-    }
-    else{
-        new_mem = (ELEM_T*)(
-                            (char*)calloc(                         new_capacity*sizeof(ELEM_T) +  STACK_DATA_SIZE_OFFSET, 1)
-                            + STACK_DATA_BEGIN_OFFSET);
-    }
+    size_t new_size = new_capacity*sizeof(elem_t) + STACK_T::data_size_offset;
+    char* new_mem = nullptr;
+    //elements that can not be moved with realloc are moved one by one to a new buffer
+    bool in_place = (old_mem != nullptr && STACK_T::relocatable);
+    if (in_place)
+        new_mem = (char*)alloc->realloc(alloc->ctx, old_mem, old_size, new_size);
+    else
+        new_mem = (char*)alloc->alloc(alloc->ctx, new_size);
+
     if (new_mem == nullptr){
         perror_log("error while reallocating memory for stack");
-        return STACK_OP_ERROR;
+        return stackCountError(stk, STACK_OP_ERROR);
+    }
+    elem_t* old_data = stk->data;
+    stk->data = (elem_t*)(new_mem + STACK_T::data_begin_offset);
+    if (!in_place && old_data != nullptr)
+        stackRelocate(stk, stk->data, old_data, stk->size);
+
+    if constexpr (STACK_T::protect){
+        if (old_mem != nullptr && old_mem != new_mem)
+            ptrUntrack(old_mem);
+        ptrTrack(new_mem, new_size);
+    }
+    if (!in_place && old_mem != nullptr)
+        alloc->free(alloc->ctx, old_mem, old_size);
+
+    if constexpr (STACK_T::stats){
+        if (new_capacity > old_capacity)
+            stk->stats_data.grows++;
+        if (new_capacity < old_capacity)
+            stk->stats_data.shrinks++;
+        stk->stats_data.realloc_bytes += new_size;
     }
-    stk->data = new_mem;
-
-    #ifndef STACK_NO_CANARY
-        *((canary_t*)(stk->data + new_capacity)) = CANARY_R;
-        *((canary_t*)(stk->data)-1)              = CANARY_L;
-    #endif
 
-    #ifndef STACK_NO_PROTECT
-        for (int i = stk->capacity; i < new_capacity; i++){
-            stk->data[i] = BAD_ELEM;
-        }
-    #endif
     stk->capacity = new_capacity;
+    stackInitBuf(stk, in_place? old_capacity : stk->size);
+    if constexpr (STACK_T::guard_pages)
+        stackGuardSetOwner(stackDataMemBegin(stk), stk, stackGuardFault<elem_t, policy_t, traits_t>);
+    if constexpr (STACK_T::hash_live && !STACK_T::relocatable){
+        if (!in_place && old_data != nullptr)
+            stk->data_hash = stackGetDataHash(stk);
+    }
     return STACK_NOERROR;
 }
 
-static stackError_t stackResize(Stack* stk, size_t new_capacity){
+//capacity to grow to, so that at least `needed` elements fit
+STACK_TEMPLATE
+size_t stackGrownCapacity(const STACK_T* stk, size_t needed){
+    size_t new_capacity = STACK_T::min_size;
+    if (stk->capacity != 0)
+        new_capacity = stk->capacity * STACK_T::growth_num / STACK_T::growth_den;
+    if (new_capacity <= stk->capacity)
+        new_capacity = stk->capacity + 1;
+    if (new_capacity < needed)
+        new_capacity = needed;
+    return new_capacity;
+}
+
+//capacity to shrink to after pop, equals current capacity if stack should not shrink
+STACK_TEMPLATE
+size_t stackShrunkCapacity(const STACK_T* stk){
+    if constexpr (STACK_T::shrink_div == 0){
+        return stk->capacity;
+    }
+    else{
+        if (stk->capacity <= STACK_T::min_size || stk->capacity <= STACK_T::inline_size ||
+            stk->size * STACK_T::shrink_div >= stk->capacity)
+            return stk->capacity;
+        size_t new_capacity = stk->size * STACK_T::shrink_mul;
+        if (new_capacity < STACK_T::min_size)
+            new_capacity = STACK_T::min_size;
+        if (new_capacity < STACK_T::inline_size)
+            new_capacity = STACK_T::inline_size;
+        return (new_capacity < stk->capacity)? new_capacity : stk->capacity;
+    }
+}
+
+STACK_TEMPLATE
+stackError_t stackResize(STACK_T* stk, size_t new_capacity){
+    stackSeqWrite(stk);
     stackError_t err = stackResize_(stk, new_capacity);
     if(err == 0)
-        stackUpdHashes(stk);
+        stackUpdHashesOp(stk);
     return err;
 }
 
 
 
-static stackError_t stackPush(Stack* stk, ELEM_T elem){
-    stackCheckRet(stk, stackError_dbg(stk));
-    #ifndef STACK_NO_PROTECT
-    (stk->info).status = VARSTATUS_NORMAL;
-    #endif
+//constructs the new top element from args in place. args must not refer to elements of stk,
+//they may be moved by the resize
+template<typename elem_t, class policy_t, class traits_t, typename... args_t>
+stackError_t stackEmplace(STACK_T* stk, args_t&&... args){
+    stackCheckRet(stk);
+    stackSeqWrite(stk);
+    //VarInfo is cold, touched only by the first push
+    if constexpr (STACK_T::protect){
+        if (stk->size == 0)
+            (stk->info).status = VARSTATUS_NORMAL;
+    }
 
     if (stk->size == stk->capacity){
-        stackError_t err = stackResize_(stk, (stk->capacity == 0)? STACK_MIN_SIZE : stk->capacity*2);
+        stackError_t err = stackResize_(stk, stackGrownCapacity(stk, stk->size + 1));
         if (err != STACK_NOERROR)
             return err;
     }
 
-    stk->data[stk->size++] = elem;
-    stackUpdHashes(stk);
+    elem_t* slot = new (stk->data + stk->size) elem_t(std::forward<args_t>(args)...);
+    stk->size++;
+    stackHashPushElem(stk, slot);
+    stackUpdHashesOp(stk);
+    stackStatsOp(stk, 1, 0);
 
     return stackError_dbg(stk);
 }
 
-static ELEM_T stackTop(Stack* stk, stackError_t *err_ptr = nullptr){
-    stackCheckRetPtr(stk, err_ptr, BAD_ELEM);
+STACK_TEMPLATE
+stackError_t stackPush(STACK_T* stk, typename STACK_T::elem_type elem){
+    return stackEmplace(stk, std::move(elem));
+}
+
+STACK_TEMPLATE
+elem_t stackTop(STACK_T* stk, stackError_t *err_ptr = nullptr){
+    stackCheckRetPtr(stk, err_ptr, traits_t::poison());
 
     if (stk->size == 0){
+        stackError_t err = stackCountError(stk, STACK_OP_INVALID);
         if (err_ptr)
-            *err_ptr = STACK_OP_INVALID;
-        return BAD_ELEM;
+            *err_ptr = err;
+        return traits_t::poison();
     }
     return stk->data[stk->size-1];
 }
 
-static ELEM_T stackPop(Stack* stk, stackError_t *err_ptr = nullptr){
-    stackCheckRetPtr(stk, err_ptr, BAD_ELEM);
+STACK_TEMPLATE
+elem_t stackPop(STACK_T* stk, stackError_t *err_ptr = nullptr){
+    stackCheckRetPtr(stk, err_ptr, traits_t::poison());
 
     if (stk->size == 0){
+        stackError_t err = stackCountError(stk, STACK_OP_INVALID);
         if (err_ptr)
-            *err_ptr = STACK_OP_INVALID;
-        return BAD_ELEM;
+            *err_ptr = err;
+        return traits_t::poison();
     }
+    stackSeqWrite(stk);
+
+    //moving changes bytes of the source, so the hash is updated first
+    elem_t* slot = stk->data + --stk->size;
+    stackHashPopElem(stk, slot);
+    elem_t ret = std::move(*slot);
+    stackDestroySlots(stk, stk->size, stk->size + 1);
+    stackPoisonSlots (stk, stk->size, stk->size + 1);
+
+    //element is already moved out: a failed shrink keeps the old buffer (stackResize_ counts
+    //and logs it) and the pop still succeeds
+    size_t new_capacity = stackShrunkCapacity(stk);
+    if (new_capacity != stk->capacity)
+        stackResize_(stk, new_capacity);
+
+    stackUpdHashesOp(stk);
+    stackStatsOp(stk, 0, 1);
+    return ret;
+}
 
-    ELEM_T ret = stk->data[--stk->size];
 
-    #ifndef STACK_NO_PROTECT
-        stk->data[stk->size] = BAD_ELEM;
-    #endif
+//Bulk operations: one check, at most one resize and one hash update per call
+
+//pushes elems[0] .. elems[n-1], elems[n-1] ends up on top
+STACK_TEMPLATE
+stackError_t stackPushN(STACK_T* stk, const typename STACK_T::elem_type* elems, size_t n){
+    stackCheckRet(stk);
+    if (n == 0)
+        return STACK_NOERROR;
+    if (elems == nullptr)
+        return stackCountError(stk, STACK_OP_INVALID);
+    stackSeqWrite(stk);
+    if constexpr (STACK_T::protect)
+        (stk->info).status = VARSTATUS_NORMAL;
 
-    if (stk->size * 2 < stk->capacity && stk->capacity > 2*STACK_MIN_SIZE){
-        stackError_t err = stackResize_(stk, (stk->capacity == 0)? STACK_MIN_SIZE : stk->size*2);
-        if (err != STACK_NOERROR){
-            if (err_ptr)
-                *err_ptr = err;
-            return BAD_ELEM;
+    if (stk->size + n > stk->capacity){
+        size_t new_capacity = stackGrownCapacity(stk, stk->size + n);
+
+        //elems may point into our own buffer (stackExtend of itself)
+        bool   own    = (elems >= stk->data && elems < stk->data + stk->capacity);
+        size_t offset = own ? elems - stk->data : 0;
+
+        stackError_t err = stackResize_(stk, new_capacity);
+        if (err != STACK_NOERROR)
+            return err;
+        if (own)
+            elems = stk->data + offset;
+    }
+
+    if constexpr (STACK_T::trivial){
+        memmove(stk->data + stk->size, elems, n * sizeof(elem_t));
+    }
+    else{
+        for (size_t i = 0; i < n; i++)
+            new (stk->data + stk->size + i) elem_t(elems[i]);
+    }
+    if constexpr (STACK_T::hash_live)
+        stk->data_hash = gnuHashAppendFast(stk->data_hash, stk->data + stk->size, stk->data + stk->size + n);
+    stk->size += n;
+    stackUpdHashesOp(stk);
+    stackStatsOp(stk, n, 0);
+
+    return stackError_dbg(stk);
+}
+
+//pops n elements into out, keeping their order: out[n-1] is the former top
+STACK_TEMPLATE
+stackError_t stackPopN(STACK_T* stk, typename STACK_T::elem_type* out, size_t n){
+    stackCheckRet(stk);
+    if (n == 0)
+        return STACK_NOERROR;
+    if (n > stk->size)
+        return stackCountError(stk, STACK_OP_INVALID);
+    stackSeqWrite(stk);
+
+    stk->size -= n;
+    elem_t* removed = stk->data + stk->size;
+    if constexpr (STACK_T::hash_live)
+        stk->data_hash = (stk->data_hash - gnuHashAppendFast(0, removed, removed + n)) * gnuHashPowInv(n * sizeof(elem_t));
+
+    if (out != nullptr){
+        if constexpr (STACK_T::trivial){
+            memcpy((void*)out, (const void*)removed, n * sizeof(elem_t));
+        }
+        else{
+            for (size_t i = 0; i < n; i++)
+                out[i] = std::move(removed[i]);
         }
+    }
+    stackDestroySlots(stk, stk->size, stk->size + n);
+    stackPoisonSlots (stk, stk->size, stk->size + n);
+
+    //elements are already in out: a failed shrink keeps the old buffer (stackResize_ counts
+    //and logs it) and the pop still succeeds
+    size_t new_capacity = stackShrunkCapacity(stk);
+    if (new_capacity != stk->capacity)
+        stackResize_(stk, new_capacity);
+
+    stackUpdHashesOp(stk);
+    stackStatsOp(stk, 0, n);
+    return stackError_dbg(stk);
+}
+
+//makes capacity at least n, so next pushes up to n elements do not realloc
+STACK_TEMPLATE
+stackError_t stackReserve(STACK_T* stk, size_t n){
+    stackCheckRet(stk);
+    if (n <= stk->capacity)
+        return STACK_NOERROR;
+    return stackResize(stk, n);
+}
 
+//releases all unused capacity
+STACK_TEMPLATE
+stackError_t stackShrinkToFit(STACK_T* stk){
+    stackCheckRet(stk);
+    if (stk->size == stk->capacity)
+        return STACK_NOERROR;
+    return stackResize(stk, stk->size);
+}
+
+STACK_TEMPLATE
+stackError_t stackGetStats(const STACK_T* stk, StackStats* stats){
+    if (stk == nullptr || stats == nullptr)
+        return STACK_NULL;
+    if constexpr (STACK_T::stats){
+        //snapshot: a copy the caller can print or export while the stack keeps running
+        *stats = stk->stats_data;
+        return STACK_NOERROR;
     }
+    else{
+        *stats = {};
+        return STACK_OP_INVALID;
+    }
+}
 
-    stackUpdHashes(stk);
-    return ret;
+//pushes all elements of src on top of stk (src is not changed)
+template<typename elem_t, class policy_t, class traits_t, class src_policy_t, class src_traits_t>
+stackError_t stackExtend(STACK_T* stk, StackT<elem_t, src_policy_t, src_traits_t>* src){
+    stackCheckRet(src);
+    return stackPushN(stk, src->data, src->size);
 }
+
+//Compatibility layer: `Stack` configured with macros (one element type per translation unit)
+//  ELEM_T, ELEM_SPEC, BAD_ELEM, STACK_MIN_SIZE, STACK_NEVER_SHRINK,
+//  NDEBUG / STACK_NO_PROTECT, STACK_NO_HASH, STACK_NO_CANARY, STACK_HASH_LIVE, STACK_BG_VERIFIER,
+//  STACK_GUARD_PAGES, STACK_NO_STATS, STACK_STATS_TIME, STACK_INLINE_SIZE, STACK_CACHE_ALIGN
+#ifdef NDEBUG
+    #define STACK_NO_PROTECT
+#endif
+
+#ifdef STACK_NO_PROTECT
+    #define STACK_NO_HASH
+    #define STACK_NO_CANARY
+#endif
+
+#ifndef ELEM_T
+    #define ELEM_T int
+#endif
+
+#ifndef STACK_MIN_SIZE
+    #define STACK_MIN_SIZE 10
+#endif
+
+namespace{
+    struct StackMacroPolicy : StackPolicyFull{
+        #ifndef STACK_NO_PROTECT
+            static constexpr bool protect = true;
+        #else
+            static constexpr bool protect = false;
+        #endif
+        #ifndef STACK_NO_CANARY
+            static constexpr bool canary  = true;
+        #else
+            static constexpr bool canary  = false;
+        #endif
+        #ifndef STACK_NO_HASH
+            static constexpr bool hash    = true;
+        #else
+            static constexpr bool hash    = false;
+        #endif
+        #ifdef STACK_HASH_LIVE
+            static constexpr bool hash_live   = true;
+        #else
+            static constexpr bool hash_live   = false;
+        #endif
+        static constexpr bool poison = protect;
+        #ifdef STACK_GUARD_PAGES
+            static constexpr bool guard_pages = true;
+        #endif
+        #ifdef STACK_BG_VERIFIER
+            static constexpr bool bg_verifier = true;
+        #else
+            static constexpr bool bg_verifier = false;
+        #endif
+        #ifndef STACK_NO_STATS
+            static constexpr bool stats = protect;
+        #else
+            static constexpr bool stats = false;
+        #endif
+        #ifdef STACK_STATS_TIME
+            static constexpr bool stats_time = true;
+        #endif
+        static constexpr size_t min_size = STACK_MIN_SIZE;
+        #ifdef STACK_INLINE_SIZE
+            static constexpr size_t inline_size = STACK_INLINE_SIZE;
+        #endif
+        #ifdef STACK_CACHE_ALIGN
+            static constexpr size_t align = STACK_CACHE_LINE;
+        #endif
+        #ifdef STACK_NEVER_SHRINK
+            static constexpr size_t shrink_div = 0;
+        #endif
+    };
+
+    #if defined(ELEM_SPEC) || defined(BAD_ELEM)
+        #ifndef ELEM_SPEC
+            #error ELEM_SPEC must be defined together with BAD_ELEM
+        #endif
+        #ifndef BAD_ELEM
+            #error BAD_ELEM must be defined together with ELEM_SPEC
+        #endif
+        struct StackMacroElemTraits{
+            static ELEM_T poison()                   { return BAD_ELEM; }
+            static bool isPoison(const ELEM_T& elem) { return elem == BAD_ELEM; }
+            static void print(const ELEM_T& elem)    { printf_log(ELEM_SPEC, elem); }
+            static constexpr const char* spec = ELEM_SPEC;
+        };
+    #else
+        typedef StackElemTraits<ELEM_T> StackMacroElemTraits;
+    #endif
+}
+
+typedef StackT<ELEM_T, StackMacroPolicy, StackMacroElemTraits> Stack;
+
+#endif // STACK_H_INCLUDED
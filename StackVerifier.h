@@ -0,0 +1,329 @@
+#ifndef STACKVERIFIER_H_INCLUDED
+#define STACKVERIFIER_H_INCLUDED
+
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <memory>
+#include <atomic>
+
+#include "Stack.h"
+
+//Background integrity verifier.
+//Periodically takes a consistent snapshot of every registered stack (seqlock on StackSeq)
+//and checks canaries and hashes on it, so the owner thread only pays a version bump and a
+//lowest-written-slot mark per op.
+//Stack policy must have bg_verifier (STACK_BG_VERIFIER for macro-configured Stack).
+//stackVerifierAdd/stackVerifierRemove must be called from the thread that owns the stack,
+//stack must be removed before stackDtor.
+
+struct StackVerifierEntry{
+    void*             stk;
+    stackError_t      (*verify)(void* stk, std::vector<uint8_t>* buf, const std::atomic<bool>* removed, bool* skipped);
+    void              (*report)(const void* stk, stackError_t err);
+    std::mutex        busy;    //held by the verifier while it reads the stack
+    std::atomic<bool> removed; //set by stackVerifierRemove, verifier leaves the stack at the next slice
+};
+
+struct StackVerifier{
+    std::thread                                      thread;
+    std::mutex                                       list_mutex;
+    std::condition_variable                          wakeup;
+    std::vector<std::shared_ptr<StackVerifierEntry>> stacks;
+    unsigned int            interval_ms = 0;
+    bool                    running     = false;
+
+    std::atomic<size_t> checks     = {0};
+    std::atomic<size_t> mismatches = {0};
+    std::atomic<size_t> skipped    = {0}; //stacks too busy to get a consistent snapshot, not counted in checks
+};
+
+const int          STACK_SNAPSHOT_TRIES      = 16;
+const unsigned int STACK_SNAPSHOT_BACKOFF_US = 20;         //sleep after the first torn try, doubled each try
+const unsigned int STACK_SNAPSHOT_MAX_US     = 5000;
+const size_t       STACK_SNAPSHOT_SLICE      = 1 << 18;    //bytes copied per buf_mutex hold
+
+//data memory of a snapshot: canaries and hash of elements, copied slice by slice
+struct StackSnapshotMem{
+    canary_t lcanary;
+    canary_t rcanary;
+    hash_t   data_hash;
+};
+
+//checks stack header copy and what was read from its data memory. Live data buffer is never touched
+STACK_TEMPLATE
+stackError_t stackErrorSnapshot(const STACK_T* head, const StackSnapshotMem* mem){
+    if (head->size == SIZE_MAX || head->capacity == SIZE_MAX || head->data == stackDestructPtr<elem_t>())
+        return STACK_DEAD;
+
+    unsigned int res = 0;
+    if (head->capacity != 0 && head->data == nullptr)
+        res |= STACK_DATA_NULL;
+    if (head->size > head->capacity)
+        res |= STACK_SIZE_CAP_BAD;
+
+    if constexpr (STACK_T::canary){
+        if (head->leftcan != CANARY_L)
+            res |= STACK_CANARY_L_BAD;
+        if (head->rightcan != CANARY_R)
+            res |= STACK_CANARY_R_BAD;
+    }
+
+    if (head->data == nullptr || mem == nullptr)
+        return (stackError_t)res;
+
+    if constexpr (STACK_T::data_lcanary){
+        if (mem->lcanary != CANARY_L)
+            res |= STACK_DATA_CANARY_L_BAD;
+    }
+    if constexpr (STACK_T::data_rcanary){
+        if (mem->rcanary != CANARY_R)
+            res |= STACK_DATA_CANARY_R_BAD;
+    }
+
+    if constexpr (STACK_T::hash){
+        if (head->struct_hash != stackGetStructHash(head) || head->alloc_hash != stackGetAllocHash(head))
+            res |= STACK_HASH_BAD;
+
+        if (!(res & STACK_SIZE_CAP_BAD) && mem->data_hash != head->data_hash)
+            res |= STACK_DATA_HASH_BAD;
+    }
+
+    return (stackError_t)res;
+}
+
+//takes a consistent snapshot of stk and checks it. Safe to call while owner thread modifies stk.
+//Data is copied and hashed in slices; after a torn try, slices below the lowest slot written
+//meanwhile (StackSeq::low) are kept. *skipped is set if stack stayed too busy or removed was set
+STACK_TEMPLATE
+stackError_t stackVerifySnapshot(STACK_T* stk, std::vector<uint8_t>* buf, const std::atomic<bool>* removed, bool* skipped){
+    static_assert(STACK_T::bg_verifier, "stack policy has no bg_verifier");
+    assert_log(stk != nullptr);
+    assert_log(stk->seq != nullptr);
+    assert_log(buf != nullptr);
+    assert_log(removed != nullptr);
+    assert_log(skipped != nullptr);
+
+    StackSeq* seq = stk->seq;
+    *skipped = false;
+
+    std::vector<hash_t> slice_hash; //hash of data up to the end of each full slice
+    const void* sliced_data = nullptr;
+    size_t      sliced_cap  = 0;
+    size_t      low         = SIZE_MAX;
+
+    for (int i = 0; i < STACK_SNAPSHOT_TRIES; i++){
+        if (i > 0){
+            unsigned int us = STACK_SNAPSHOT_BACKOFF_US << (i - 1);
+            std::this_thread::sleep_for(std::chrono::microseconds(us < STACK_SNAPSHOT_MAX_US ? us : STACK_SNAPSHOT_MAX_US));
+        }
+        if (removed->load(std::memory_order_relaxed))
+            break;
+
+        uint64_t ver = seq->version.load(std::memory_order_acquire);
+        if (ver & 1)
+            continue;
+        //marks of every op finished before ver are taken here or were taken by earlier tries
+        size_t new_low = seq->low.exchange(SIZE_MAX, std::memory_order_acq_rel);
+        if (new_low < low)
+            low = new_low;
+
+        STACK_T head = {};
+        memcpy((void*)&head, stk, sizeof(head));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq->version.load(std::memory_order_relaxed) != ver)
+            continue;
+
+        stackError_t err = stackErrorSnapshot(&head, nullptr);
+        if (err & (STACK_DEAD | STACK_DATA_NULL | STACK_SIZE_CAP_BAD) || head.data == nullptr)
+            return err;
+
+        if (head.data != sliced_data || head.capacity != sliced_cap){
+            slice_hash.clear();
+            sliced_data = head.data;
+            sliced_cap  = head.capacity;
+        }
+        size_t low_slices = (low >= SIZE_MAX / sizeof(elem_t))? SIZE_MAX : low * sizeof(elem_t) / STACK_SNAPSHOT_SLICE;
+        if (slice_hash.size() > low_slices)
+            slice_hash.resize(low_slices);
+
+        const uint8_t* data  = (const uint8_t*)head.data;
+        size_t         bytes = (STACK_T::hash_live ? head.size : head.capacity) * sizeof(elem_t);
+        size_t         off   = slice_hash.size() * STACK_SNAPSHOT_SLICE;
+        StackSnapshotMem mem = {};
+        mem.data_hash = slice_hash.empty()? HASH_DEFAULT : slice_hash.back();
+
+        bool torn = false;
+        while (off < bytes && !torn){
+            if (removed->load(std::memory_order_relaxed)){
+                *skipped = true;
+                return STACK_NOERROR;
+            }
+            size_t len = (bytes - off < STACK_SNAPSHOT_SLICE)? bytes - off : STACK_SNAPSHOT_SLICE;
+            buf->resize(len);
+            {
+                //buffer in head is alive only if no write section has started since header was copied
+                std::lock_guard<std::mutex> lock(seq->buf_mutex);
+                torn = (seq->version.load(std::memory_order_acquire) != ver);
+                if (!torn)
+                    memcpy(buf->data(), data + off, len);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (torn || seq->version.load(std::memory_order_relaxed) != ver){
+                torn = true;
+                break;
+            }
+            mem.data_hash = stackHashDataAppend(&head, mem.data_hash, buf->data(), buf->data() + len);
+            off += len;
+            if (len == STACK_SNAPSHOT_SLICE)
+                slice_hash.push_back(mem.data_hash);
+        }
+        if (torn)
+            continue;
+
+        {
+            std::lock_guard<std::mutex> lock(seq->buf_mutex);
+            torn = (seq->version.load(std::memory_order_acquire) != ver);
+            if (!torn){
+                if constexpr (STACK_T::data_lcanary)
+                    mem.lcanary = getLCanary(head.data);
+                if constexpr (STACK_T::data_rcanary)
+                    mem.rcanary = getRCanary(head.data, head.capacity * sizeof(elem_t));
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (torn || seq->version.load(std::memory_order_relaxed) != ver)
+            continue;
+
+        return stackErrorSnapshot(&head, &mem);
+    }
+    *skipped = true;
+    return STACK_NOERROR;
+}
+
+STACK_TEMPLATE
+void stackVerifierReport(const STACK_T* stk, stackError_t err){
+    if (!LOG_ENABLED(LOG_LEVEL_ERROR))
+        return;
+    error_log("Background verifier: stack %p error %x\n", stk, err);
+    if constexpr (STACK_T::protect)
+        printVarInfo_log(&(stk->info));
+    if (err & STACK_CANARY_L_BAD)      printf_log("      (BAD)  Struct L canary BAD!\n");
+    if (err & STACK_CANARY_R_BAD)      printf_log("      (BAD)  Struct R canary BAD!\n");
+    if (err & STACK_DATA_CANARY_L_BAD) printf_log("      (BAD)  Data L canary BAD!\n");
+    if (err & STACK_DATA_CANARY_R_BAD) printf_log("      (BAD)  Data R canary BAD!\n");
+    if (err & STACK_HASH_BAD)          printf_log("      (BAD)  Struct hash invalid\n");
+    if (err & STACK_DATA_HASH_BAD)     printf_log("      (BAD)  Data hash invalid\n");
+    if (err & STACK_SIZE_CAP_BAD)      printf_log("      (BAD)  Stack size is larger than capacity\n");
+    if (err & STACK_DATA_NULL)         printf_log("      (BAD)  Stack data poiner is null\n");
+}
+
+//entry list is copied under list_mutex and stacks are verified outside it
+inline void stackVerifierLoop(StackVerifier* ver){
+    std::vector<uint8_t> buf;
+    std::vector<std::shared_ptr<StackVerifierEntry>> stacks;
+    std::unique_lock<std::mutex> lock(ver->list_mutex);
+    while (ver->running){
+        stacks = ver->stacks;
+        lock.unlock();
+        for (std::shared_ptr<StackVerifierEntry>& entry : stacks){
+            std::lock_guard<std::mutex> busy(entry->busy);
+            if (entry->removed.load(std::memory_order_relaxed))
+                continue;
+            bool skipped = false;
+            stackError_t err = entry->verify(entry->stk, &buf, &entry->removed, &skipped);
+            if (skipped){
+                ver->skipped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            ver->checks.fetch_add(1, std::memory_order_relaxed);
+            if (err != STACK_NOERROR && !(err & STACK_DEAD)){
+                ver->mismatches.fetch_add(1, std::memory_order_relaxed);
+                entry->report(entry->stk, err);
+            }
+        }
+        stacks.clear();
+        lock.lock();
+        if (ver->running)
+            ver->wakeup.wait_for(lock, std::chrono::milliseconds(ver->interval_ms));
+    }
+}
+
+inline void stackVerifierStart(StackVerifier* ver, unsigned int interval_ms){
+    assert_log(ver != nullptr);
+    assert_log(!ver->running);
+
+    ver->interval_ms = interval_ms;
+    ver->running     = true;
+    ver->thread      = std::thread(stackVerifierLoop, ver);
+}
+
+inline void stackVerifierStop(StackVerifier* ver){
+    assert_log(ver != nullptr);
+    {
+        std::lock_guard<std::mutex> lock(ver->list_mutex);
+        ver->running = false;
+    }
+    ver->wakeup.notify_all();
+    if (ver->thread.joinable())
+        ver->thread.join();
+}
+
+STACK_TEMPLATE
+stackError_t stackVerifierAdd(StackVerifier* ver, STACK_T* stk){
+    static_assert(STACK_T::bg_verifier, "stack policy has no bg_verifier");
+    assert_log(ver != nullptr);
+    stackCheckRet(stk);
+    if (stk->seq != nullptr)
+        return STACK_OP_INVALID;
+
+    StackSeq* seq = new StackSeq;
+    seq->version.store(0);
+    seq->low.store(SIZE_MAX);
+
+    std::shared_ptr<StackVerifierEntry> entry = std::make_shared<StackVerifierEntry>();
+    entry->stk    = stk;
+    entry->verify = [](void* ptr, std::vector<uint8_t>* buf, const std::atomic<bool>* removed, bool* skipped){
+        return stackVerifySnapshot((STACK_T*)ptr, buf, removed, skipped);
+    };
+    entry->report = [](const void* ptr, stackError_t err){
+        stackVerifierReport((const STACK_T*)ptr, err);
+    };
+    entry->removed.store(false);
+
+    std::lock_guard<std::mutex> lock(ver->list_mutex);
+    stk->seq = seq;
+    ver->stacks.push_back(entry);
+    return STACK_NOERROR;
+}
+
+//waits at most for one slice the verifier is copying from stk
+STACK_TEMPLATE
+stackError_t stackVerifierRemove(StackVerifier* ver, STACK_T* stk){
+    assert_log(ver != nullptr);
+    assert_log(stk != nullptr);
+
+    std::shared_ptr<StackVerifierEntry> entry;
+    {
+        std::lock_guard<std::mutex> lock(ver->list_mutex);
+        for (size_t i = 0; i < ver->stacks.size(); i++){
+            if (ver->stacks[i]->stk == stk){
+                entry = ver->stacks[i];
+                ver->stacks.erase(ver->stacks.begin() + i);
+                break;
+            }
+        }
+    }
+    if (!entry)
+        return STACK_OP_INVALID;
+
+    entry->removed.store(true, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> busy(entry->busy);
+    }
+    delete stk->seq;
+    stk->seq = nullptr;
+    return STACK_NOERROR;
+}
+
+#endif // STACKVERIFIER_H_INCLUDED
@@ -0,0 +1,500 @@
+#ifndef STEALDEQUE_H_INCLUDED
+#define STEALDEQUE_H_INCLUDED
+
+#include <atomic>
+
+#include "Stack.h"
+
+//Chase-Lev work-stealing deque.
+//Owner thread uses stackPush/stackPop at the top (LIFO), any thread may stackSteal from the bottom.
+//Owner ops touch only relaxed atomics, except one fence when pop may race with a thief for the
+//last element. Thieves CAS the bottom index.
+//Elements live in a circular buffer from the deque's StackAllocator, laid out like a SegStack chunk
+//([header][canary][elements][canary]), capacity is a power of two. Grown buffers are kept until
+//stackDtor, because a slow thief may still read the old one, so the deque never shrinks.
+//Policy: protect, canary and poison are used. Free slots are poisoned when a buffer is allocated
+//and when the owner pops, stolen slots are not (the owner may already be reusing them).
+//There is no data hash: every steal would have to update it from another thread.
+//stackCtor/stackDtor/stackDump/stackSetAllocator need the deque to be quiescent
+
+template<typename elem_t>
+struct StealDequeBuf{
+    size_t            capacity;
+    elem_t*           data;
+    StealDequeBuf*    retired; //previous buffer
+};
+
+//written by the owner with relaxed stores, so stackGetStats may read them from any thread
+struct StealDequeStats{
+    std::atomic<size_t> pushes;
+    std::atomic<size_t> pops;
+    std::atomic<size_t> high_water;
+    std::atomic<size_t> grows;
+    std::atomic<size_t> realloc_bytes;
+};
+
+template<typename elem_t, class policy_t = StackPolicyFull, class traits_t = StackElemTraits<elem_t>>
+struct StealDequeT{
+    typedef elem_t   elem_type;
+    typedef policy_t policy_type;
+    typedef traits_t traits_type;
+    typedef StealDequeBuf<elem_t> buf_type;
+
+    static constexpr bool   protect     = policy_t::protect;
+    static constexpr bool   canary      = protect && policy_t::canary;
+    static constexpr bool   poison      = protect && policy_t::poison;
+    static constexpr bool   stats       = policy_t::stats;
+    static constexpr size_t min_size    = policy_t::min_size;
+
+    static_assert(std::is_trivially_copyable_v<elem_t>, "elements are read by racing threads, use StackT for this type");
+
+    //data follows the buffer header and left canary, aligned for elem_t
+    static constexpr size_t elem_align        = (alignof(elem_t) > alignof(canary_t))? alignof(elem_t) : alignof(canary_t);
+    static constexpr size_t header_size       = (sizeof(buf_type) + elem_align - 1) / elem_align * elem_align;
+    static constexpr size_t data_begin_offset = !canary                             ? 0 :
+                                                (alignof(elem_t) > sizeof(canary_t))? alignof(elem_t) : sizeof(canary_t);
+    static constexpr size_t data_size_offset  = canary ? data_begin_offset + sizeof(canary_t) : 0;
+
+    [[no_unique_address]] StackField<canary , canary_t, 0> leftcan;
+
+    alignas(64) std::atomic<int64_t>   bottom; //next slot to steal from
+    alignas(64) std::atomic<int64_t>   top;    //next slot to push to, written by owner only
+    std::atomic<buf_type*>             buf;
+    [[no_unique_address]] StackField<stats  , StealDequeStats, 9> stats_data; //on the line owner writes anyway
+
+    const StackAllocator* allocator; //buffer allocator, see stackSetAllocator
+
+    [[no_unique_address]] StackField<protect, VarInfo   , 1> info;
+
+    [[no_unique_address]] StackField<canary , canary_t, 8> rightcan;
+};
+
+#ifdef STEAL_DEQUE_TEMPLATE
+    #error redefinition of internal macro STEAL_DEQUE_TEMPLATE
+#endif
+#define STEAL_DEQUE_TEMPLATE template<typename elem_t, class policy_t, class traits_t>
+#ifdef STEAL_DEQUE_T
+    #error redefinition of internal macro STEAL_DEQUE_T
+#endif
+#define STEAL_DEQUE_T StealDequeT<elem_t, policy_t, traits_t>
+
+//owner only: plain load and store, no read-modify-write
+inline void stealDequeStatAdd(std::atomic<size_t>* stat, size_t value){
+    stat->store(stat->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+STEAL_DEQUE_TEMPLATE
+inline size_t stealDequeBufMemSize(size_t capacity){
+    return STEAL_DEQUE_T::header_size + STEAL_DEQUE_T::data_size_offset + capacity * sizeof(elem_t);
+}
+
+STEAL_DEQUE_TEMPLATE
+StealDequeBuf<elem_t>* stealDequeBufAlloc(STEAL_DEQUE_T* deq, size_t capacity){
+    size_t mem_size = stealDequeBufMemSize<elem_t, policy_t, traits_t>(capacity);
+    errno = 0;
+    StealDequeBuf<elem_t>* buf = (StealDequeBuf<elem_t>*)deq->allocator->alloc(deq->allocator->ctx, mem_size);
+    if (buf == nullptr)
+        return nullptr;
+
+    buf->capacity = capacity;
+    buf->data     = (elem_t*)((char*)buf + STEAL_DEQUE_T::header_size + STEAL_DEQUE_T::data_begin_offset);
+    buf->retired  = nullptr;
+
+    if constexpr (STEAL_DEQUE_T::canary){
+        setRCanary(buf->data, capacity * sizeof(elem_t));
+        setLCanary(buf->data);
+    }
+    if constexpr (STEAL_DEQUE_T::poison){
+        for (size_t i = 0; i < capacity; i++)
+            buf->data[i] = traits_t::poison();
+    }
+    if constexpr (STEAL_DEQUE_T::protect)
+        ptrTrack(buf, mem_size);
+    if constexpr (STEAL_DEQUE_T::stats)
+        stealDequeStatAdd(&deq->stats_data.realloc_bytes, mem_size);
+    return buf;
+}
+
+//buf and all buffers it retired
+STEAL_DEQUE_TEMPLATE
+void stealDequeBufFree(const StackAllocator* allocator, StealDequeBuf<elem_t>* buf){
+    while (buf != nullptr){
+        StealDequeBuf<elem_t>* retired = buf->retired;
+        if constexpr (STEAL_DEQUE_T::protect)
+            ptrUntrack(buf);
+        allocator->free(allocator->ctx, buf, stealDequeBufMemSize<elem_t, policy_t, traits_t>(buf->capacity));
+        buf = retired;
+    }
+}
+
+template<typename elem_t>
+inline elem_t* stealDequeSlot(StealDequeBuf<elem_t>* buf, int64_t index){
+    return buf->data + (index & (buf->capacity - 1));
+}
+
+STEAL_DEQUE_TEMPLATE
+bool stackCtor_(STEAL_DEQUE_T* deq, VarInfo info){
+    if constexpr (STEAL_DEQUE_T::protect){
+        if (isBadWritePtr(deq, sizeof(*deq))){
+            return false;
+        }
+    }
+    size_t capacity = 1;
+    while (capacity < STEAL_DEQUE_T::min_size)
+        capacity *= 2;
+
+    if constexpr (STEAL_DEQUE_T::stats){
+        deq->stats_data.pushes       .store(0);
+        deq->stats_data.pops         .store(0);
+        deq->stats_data.high_water   .store(0);
+        deq->stats_data.grows        .store(0);
+        deq->stats_data.realloc_bytes.store(0);
+    }
+
+    deq->allocator = &stack_malloc_allocator;
+    deq->bottom.store(0);
+    deq->top   .store(0);
+    deq->buf   .store(stealDequeBufAlloc(deq, capacity));
+    if (deq->buf.load() == nullptr){
+        perror_log("error while allocating memory for deque");
+        return false;
+    }
+    if constexpr (STEAL_DEQUE_T::protect){
+        ptrTrack(deq, sizeof(*deq));
+        deq->info = info;
+    }
+    if constexpr (STEAL_DEQUE_T::canary){
+        deq->leftcan  = CANARY_L;
+        deq->rightcan = CANARY_R;
+    }
+    return true;
+}
+
+//canaries only, safe to call from any thread
+STEAL_DEQUE_TEMPLATE
+stackError_t stackErrorCheap(const STEAL_DEQUE_T* deq){
+    if (deq == nullptr)
+        return STACK_NULL;
+
+    StealDequeBuf<elem_t>* buf = deq->buf.load(std::memory_order_acquire);
+    if (buf == stackDestructPtr<StealDequeBuf<elem_t>>())
+        return STACK_DEAD;
+
+    unsigned int err = 0;
+    if constexpr (STEAL_DEQUE_T::canary){
+        if (deq->leftcan != CANARY_L)
+            err |= STACK_CANARY_L_BAD;
+        if (deq->rightcan != CANARY_R)
+            err |= STACK_CANARY_R_BAD;
+    }
+    if (buf == nullptr || buf->data == nullptr)
+        return (stackError_t)(err | STACK_DATA_NULL);
+
+    if constexpr (STEAL_DEQUE_T::canary){
+        if (!checkLCanary(buf->data))
+            err |= STACK_DATA_CANARY_L_BAD;
+        if (!checkRCanary(buf->data, buf->capacity * sizeof(elem_t)))
+            err |= STACK_DATA_CANARY_R_BAD;
+    }
+    return (stackError_t)err;
+}
+
+//size check is exact only on the owner thread or when deque is quiescent
+STEAL_DEQUE_TEMPLATE
+stackError_t stackError(const STEAL_DEQUE_T* deq){
+    if (deq == nullptr)
+        return STACK_NULL;
+
+    if constexpr (STEAL_DEQUE_T::protect){
+        if (isBadReadPtr(deq, sizeof(*deq)))
+            return STACK_BAD;
+    }
+
+    int64_t bottom = deq->bottom.load(std::memory_order_acquire);
+    int64_t top    = deq->top   .load(std::memory_order_acquire);
+    StealDequeBuf<elem_t>* buf = deq->buf.load(std::memory_order_acquire);
+    if (buf == stackDestructPtr<StealDequeBuf<elem_t>>())
+        return STACK_DEAD;
+
+    unsigned int err = 0;
+    if constexpr (STEAL_DEQUE_T::canary){
+        if (deq->leftcan != CANARY_L)
+            err |= STACK_CANARY_L_BAD;
+        if (deq->rightcan != CANARY_R)
+            err |= STACK_CANARY_R_BAD;
+    }
+
+    if (buf == nullptr || buf->data == nullptr)
+        return (stackError_t)(err | STACK_DATA_NULL);
+
+    if (top - bottom > (int64_t)buf->capacity)
+        err |= STACK_SIZE_CAP_BAD;
+
+    if constexpr (STEAL_DEQUE_T::canary){
+        if (!checkLCanary(buf->data))
+            err |= STACK_DATA_CANARY_L_BAD;
+        if (!checkRCanary(buf->data, buf->capacity * sizeof(elem_t)))
+            err |= STACK_DATA_CANARY_R_BAD;
+    }
+    return (stackError_t)err;
+}
+
+STEAL_DEQUE_TEMPLATE
+inline stackError_t stackCheck(STEAL_DEQUE_T* deq){
+    if constexpr (STEAL_DEQUE_T::protect)
+        return stackError(deq);
+    else
+        return STACK_NOERROR;
+}
+
+STEAL_DEQUE_TEMPLATE
+inline stackError_t stackError_dbg(STEAL_DEQUE_T* deq){
+    return stackCheck(deq);
+}
+
+STEAL_DEQUE_TEMPLATE
+void stackDump(const STEAL_DEQUE_T* deq){
+    if (!LOG_ENABLED(LOG_LEVEL_INFO))
+        return;
+
+    info_log("Work-stealing deque dump:\n      deque at %p \n", deq);
+
+    stackError_t err = stackError(deq);
+    if (err & STACK_NULL){
+        printf_log("      (BAD)  Deque poiner is null\n");
+        return;
+    }
+    if (err & STACK_BAD){
+        printf_log("      (BAD)  Deque poiner is invalid\n");
+        return;
+    }
+    if (err & STACK_DEAD){
+        printf_log("      (BAD)  Deque was already destructed\n\n");
+        return;
+    }
+
+    StealDequeBuf<elem_t>* buf = deq->buf.load();
+    int64_t bottom = deq->bottom.load();
+    int64_t top    = deq->top.load();
+    printf_log("      [%lld, %lld) of %ld elements\n", (long long)bottom, (long long)top, (buf)? buf->capacity : 0);
+    printf_log("      Data: %p\n", (buf)? buf->data : nullptr);
+
+    if constexpr (STEAL_DEQUE_T::protect)
+        printVarInfo_log(&(deq->info));
+
+    if constexpr (STEAL_DEQUE_T::canary){
+        if (err & STACK_CANARY_L_BAD){
+            printf_log("      (BAD)  Struct L canary BAD! Value: %p\n", deq->leftcan);
+        }
+        if (err & STACK_CANARY_R_BAD){
+            printf_log("      (BAD)  Struct R canary BAD! Value: %p\n", deq->rightcan);
+        }
+    }
+    if (err & STACK_DATA_NULL){
+        printf_log("      (BAD)  Deque buffer is null\n\n");
+        return;
+    }
+    if (err & STACK_SIZE_CAP_BAD){
+        printf_log("      (BAD)  Deque size is larger than capacity\n\n");
+        return;
+    }
+    if constexpr (STEAL_DEQUE_T::canary){
+        if (err & STACK_DATA_CANARY_L_BAD){
+            printf_log("      (BAD)  Data L canary BAD! Value: %p\n", getLCanary(buf->data));
+        }
+        if (err & STACK_DATA_CANARY_R_BAD){
+            printf_log("      (BAD)  Data R canary BAD! Value: %p\n",getRCanary(buf->data, buf->capacity * sizeof(elem_t)));
+        }
+    }
+    printf_log("\n");
+
+    for (int64_t i = bottom; i < top; i++){
+        printf_log("    *[%lld] ", (long long)i);
+        traits_t::print(*stealDequeSlot(buf, i));
+        printf_log("\n");
+    }
+    printf_log("\n");
+}
+
+STEAL_DEQUE_TEMPLATE
+stackError_t stackDtor(STEAL_DEQUE_T* deq){
+    stackCheckRet(deq);
+
+    stealDequeBufFree<elem_t, policy_t, traits_t>(deq->allocator, deq->buf.load());
+    deq->buf.store(stackDestructPtr<StealDequeBuf<elem_t>>());
+    deq->bottom.store(0);
+    deq->top   .store(0);
+    if constexpr (STEAL_DEQUE_T::protect){
+        ptrUntrack(deq);
+        (deq->info).status = VARSTATUS_DEAD;
+    }
+    return STACK_NOERROR;
+}
+
+//allocator must outlive the deque. Can only be changed while deque is empty and quiescent,
+//its buffer is reallocated with the new allocator
+STEAL_DEQUE_TEMPLATE
+stackError_t stackSetAllocator(STEAL_DEQUE_T* deq, const StackAllocator* allocator){
+    stackCheckRet(deq);
+    StealDequeBuf<elem_t>* buf = deq->buf.load();
+    if (allocator == nullptr || deq->top.load() != deq->bottom.load())
+        return STACK_OP_INVALID;
+
+    const StackAllocator* old_allocator = deq->allocator;
+    deq->allocator = allocator;
+    StealDequeBuf<elem_t>* new_buf = stealDequeBufAlloc(deq, buf->capacity);
+    if (new_buf == nullptr){
+        deq->allocator = old_allocator;
+        perror_log("error while allocating memory for deque");
+        return STACK_OP_ERROR;
+    }
+    stealDequeBufFree<elem_t, policy_t, traits_t>(old_allocator, buf);
+    deq->buf.store(new_buf);
+    return STACK_NOERROR;
+}
+
+//owner only: copies live elements into a buffer twice as big
+STEAL_DEQUE_TEMPLATE
+StealDequeBuf<elem_t>* stealDequeGrow(STEAL_DEQUE_T* deq, StealDequeBuf<elem_t>* buf, int64_t bottom, int64_t top){
+    StealDequeBuf<elem_t>* new_buf = stealDequeBufAlloc(deq, buf->capacity * 2);
+    if (new_buf == nullptr){
+        perror_log("error while reallocating memory for deque");
+        return nullptr;
+    }
+    for (int64_t i = bottom; i < top; i++)
+        *stealDequeSlot(new_buf, i) = *stealDequeSlot(buf, i);
+    new_buf->retired = buf;
+    deq->buf.store(new_buf, std::memory_order_release);
+
+    if constexpr (STEAL_DEQUE_T::stats)
+        stealDequeStatAdd(&deq->stats_data.grows, 1);
+    return new_buf;
+}
+
+//owner only
+STEAL_DEQUE_TEMPLATE
+stackError_t stackPush(STEAL_DEQUE_T* deq, typename STEAL_DEQUE_T::elem_type elem){
+    stackCheckRet(deq);
+    if constexpr (STEAL_DEQUE_T::protect)
+        (deq->info).status = VARSTATUS_NORMAL;
+
+    int64_t top    = deq->top   .load(std::memory_order_relaxed);
+    int64_t bottom = deq->bottom.load(std::memory_order_acquire);
+    StealDequeBuf<elem_t>* buf = deq->buf.load(std::memory_order_relaxed);
+
+    if (top - bottom >= (int64_t)buf->capacity){
+        buf = stealDequeGrow(deq, buf, bottom, top);
+        if (buf == nullptr)
+            return STACK_OP_ERROR;
+    }
+    *stealDequeSlot(buf, top) = elem;
+    std::atomic_thread_fence(std::memory_order_release);
+    deq->top.store(top + 1, std::memory_order_relaxed);
+
+    if constexpr (STEAL_DEQUE_T::stats){
+        stealDequeStatAdd(&deq->stats_data.pushes, 1);
+        size_t size = (size_t)(top + 1 - bottom);
+        if (size > deq->stats_data.high_water.load(std::memory_order_relaxed))
+            deq->stats_data.high_water.store(size, std::memory_order_relaxed);
+    }
+    return STACK_NOERROR;
+}
+
+//owner only, takes the newest element
+STEAL_DEQUE_TEMPLATE
+elem_t stackPop(STEAL_DEQUE_T* deq, stackError_t *err_ptr = nullptr){
+    stackCheckRetPtr(deq, err_ptr, traits_t::poison());
+
+    int64_t top = deq->top.load(std::memory_order_relaxed) - 1;
+    StealDequeBuf<elem_t>* buf = deq->buf.load(std::memory_order_relaxed);
+    deq->top.store(top, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = deq->bottom.load(std::memory_order_relaxed);
+
+    if (bottom > top){
+        deq->top.store(top + 1, std::memory_order_relaxed);
+        if (err_ptr)
+            *err_ptr = STACK_OP_INVALID;
+        return traits_t::poison();
+    }
+
+    elem_t ret = *stealDequeSlot(buf, top);
+    if (bottom == top){
+        //last element, race with thieves for it
+        bool won = deq->bottom.compare_exchange_strong(bottom, bottom + 1, std::memory_order_seq_cst,
+                                                                           std::memory_order_relaxed);
+        if (!won){
+            deq->top.store(top + 1, std::memory_order_relaxed);
+            if (err_ptr)
+                *err_ptr = STACK_OP_INVALID;
+            return traits_t::poison();
+        }
+        //thieves that read the slot before the CAS lost it, later ones see bottom > top
+        if constexpr (STEAL_DEQUE_T::poison)
+            *stealDequeSlot(buf, top) = traits_t::poison();
+        deq->top.store(top + 1, std::memory_order_relaxed);
+    }
+    else if constexpr (STEAL_DEQUE_T::poison){
+        //thieves only read slots below top
+        *stealDequeSlot(buf, top) = traits_t::poison();
+    }
+
+    if constexpr (STEAL_DEQUE_T::stats)
+        stealDequeStatAdd(&deq->stats_data.pops, 1);
+    return ret;
+}
+
+//any thread, takes the oldest element. STACK_OP_INVALID: deque is empty,
+//STACK_OP_ERROR: lost the race for the element to another thread, worth trying again
+STEAL_DEQUE_TEMPLATE
+elem_t stackSteal(STEAL_DEQUE_T* deq, stackError_t *err_ptr = nullptr){
+    if constexpr (STEAL_DEQUE_T::protect){
+        if (stackError_t err = stackErrorCheap(deq)){
+            error_log("Work-stealing deque %p error %x\n", deq, err);
+            if (err_ptr)
+                *err_ptr = err;
+            return traits_t::poison();
+        }
+    }
+
+    int64_t bottom = deq->bottom.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top    = deq->top.load(std::memory_order_acquire);
+
+    if (bottom >= top){
+        if (err_ptr)
+            *err_ptr = STACK_OP_INVALID;
+        return traits_t::poison();
+    }
+
+    StealDequeBuf<elem_t>* buf = deq->buf.load(std::memory_order_acquire);
+    elem_t ret = *stealDequeSlot(buf, bottom);
+    if (!deq->bottom.compare_exchange_strong(bottom, bottom + 1, std::memory_order_seq_cst,
+                                                                 std::memory_order_relaxed)){
+        if (err_ptr)
+            *err_ptr = STACK_OP_ERROR;
+        return traits_t::poison();
+    }
+    return ret;
+}
+
+STEAL_DEQUE_TEMPLATE
+stackError_t stackGetStats(const STEAL_DEQUE_T* deq, StackStats* stats){
+    if (deq == nullptr || stats == nullptr)
+        return STACK_NULL;
+    if constexpr (STEAL_DEQUE_T::stats){
+        *stats = {};
+        stats->pushes        = deq->stats_data.pushes       .load(std::memory_order_relaxed);
+        stats->pops          = deq->stats_data.pops         .load(std::memory_order_relaxed);
+        stats->high_water    = deq->stats_data.high_water   .load(std::memory_order_relaxed);
+        stats->grows         = deq->stats_data.grows        .load(std::memory_order_relaxed);
+        stats->realloc_bytes = deq->stats_data.realloc_bytes.load(std::memory_order_relaxed);
+        return STACK_NOERROR;
+    }
+    else{
+        *stats = {};
+        return STACK_OP_INVALID;
+    }
+}
+
+#endif // STEALDEQUE_H_INCLUDED
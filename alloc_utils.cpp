@@ -0,0 +1,481 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#ifdef __linux__
+    #include <sys/mman.h>
+    #include <signal.h>
+    #include <unistd.h>
+#endif
+
+#include "alloc_utils.h"
+#include "ptr_utils.h"
+
+static void* mallocAlloc(void*, size_t size){
+    return malloc(size);
+}
+static void* mallocRealloc(void*, void* ptr, size_t, size_t new_size){
+    return realloc(ptr, new_size);
+}
+static void mallocFree(void*, void* ptr, size_t){
+    free(ptr);
+}
+
+const StackAllocator stack_malloc_allocator = {mallocAlloc, mallocRealloc, mallocFree, nullptr};
+
+
+static const int    ARENA_CLASS_COUNT     = 12;
+static const size_t ARENA_MIN_CLASS_SIZE  = 32;   //classes are 32, 64, ... 64K bytes
+static const size_t ARENA_ALIGN           = 16;
+static const size_t ARENA_MIN_CHUNK_SIZE  = ARENA_MIN_CLASS_SIZE << (ARENA_CLASS_COUNT - 1);
+
+struct ArenaFreeBlock{
+    ArenaFreeBlock* next;
+};
+
+struct ArenaChunk{
+    ArenaChunk* next;
+    alignas(ARENA_ALIGN) uint8_t mem[];
+};
+
+struct alignas(ARENA_ALIGN) ArenaLarge{
+    ArenaLarge* prev;
+    ArenaLarge* next;
+};
+
+struct StackArena{
+    StackAllocator  allocator;
+    size_t          chunk_size;
+    ArenaChunk*     chunks;
+    uint8_t*        bump;
+    uint8_t*        bump_end;
+    ArenaFreeBlock* free_lists[ARENA_CLASS_COUNT];
+    ArenaLarge*     large;
+    StackArenaStats stats;
+};
+
+static void* arenaAlloc  (void* ctx, size_t size);
+static void* arenaRealloc(void* ctx, void* ptr, size_t old_size, size_t new_size);
+static void  arenaFree   (void* ctx, void* ptr, size_t size);
+
+static int arenaSizeClass(size_t size){
+    size_t class_size = ARENA_MIN_CLASS_SIZE;
+    for (int i = 0; i < ARENA_CLASS_COUNT; i++){
+        if (size <= class_size)
+            return i;
+        class_size <<= 1;
+    }
+    return -1;
+}
+
+StackArena* stackArenaCreate(size_t chunk_size){
+    StackArena* arena = (StackArena*)calloc(1, sizeof(StackArena));
+    if (arena == nullptr)
+        return nullptr;
+    arena->chunk_size = (chunk_size < ARENA_MIN_CHUNK_SIZE)? ARENA_MIN_CHUNK_SIZE : chunk_size;
+    arena->allocator  = {arenaAlloc, arenaRealloc, arenaFree, arena};
+    return arena;
+}
+
+void stackArenaReset(StackArena* arena){
+    if (arena == nullptr)
+        return;
+
+    while (arena->chunks != nullptr){
+        ArenaChunk* next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    while (arena->large != nullptr){
+        ArenaLarge* next = arena->large->next;
+        free(arena->large);
+        arena->large = next;
+    }
+    arena->bump     = nullptr;
+    arena->bump_end = nullptr;
+    memset(arena->free_lists, 0, sizeof(arena->free_lists));
+}
+
+void stackArenaDestroy(StackArena* arena){
+    stackArenaReset(arena);
+    free(arena);
+}
+
+static void* arenaAllocLarge(StackArena* arena, size_t size){
+    ArenaLarge* block = (ArenaLarge*)malloc(sizeof(ArenaLarge) + size);
+    if (block == nullptr)
+        return nullptr;
+    block->prev = nullptr;
+    block->next = arena->large;
+    if (arena->large != nullptr)
+        arena->large->prev = block;
+    arena->large = block;
+    arena->stats.large_allocs++;
+    return block + 1;
+}
+
+static void arenaFreeLarge(StackArena* arena, void* ptr){
+    ArenaLarge* block = (ArenaLarge*)ptr - 1;
+    if (block->prev != nullptr)
+        block->prev->next = block->next;
+    else
+        arena->large = block->next;
+    if (block->next != nullptr)
+        block->next->prev = block->prev;
+    free(block);
+}
+
+static void* arenaAlloc(void* ctx, size_t size){
+    StackArena* arena = (StackArena*)ctx;
+    arena->stats.allocs++;
+
+    int size_class = arenaSizeClass(size);
+    if (size_class < 0)
+        return arenaAllocLarge(arena, size);
+
+    ArenaFreeBlock* block = arena->free_lists[size_class];
+    if (block != nullptr){
+        arena->free_lists[size_class] = block->next;
+        arena->stats.reused++;
+        return block;
+    }
+
+    size_t class_size = ARENA_MIN_CLASS_SIZE << size_class;
+    if (arena->bump == nullptr || (size_t)(arena->bump_end - arena->bump) < class_size){
+        ArenaChunk* chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + arena->chunk_size);
+        if (chunk == nullptr)
+            return nullptr;
+        chunk->next     = arena->chunks;
+        arena->chunks   = chunk;
+        arena->bump     = chunk->mem;
+        arena->bump_end = chunk->mem + arena->chunk_size;
+        arena->stats.chunks++;
+    }
+    void* res = arena->bump;
+    arena->bump += class_size;
+    return res;
+}
+
+static void arenaFree(void* ctx, void* ptr, size_t size){
+    StackArena* arena = (StackArena*)ctx;
+    if (ptr == nullptr)
+        return;
+
+    int size_class = arenaSizeClass(size);
+    if (size_class < 0){
+        arenaFreeLarge(arena, ptr);
+        return;
+    }
+    ArenaFreeBlock* block = (ArenaFreeBlock*)ptr;
+    block->next = arena->free_lists[size_class];
+    arena->free_lists[size_class] = block;
+}
+
+static void* arenaRealloc(void* ctx, void* ptr, size_t old_size, size_t new_size){
+    if (ptr == nullptr)
+        return arenaAlloc(ctx, new_size);
+
+    int old_class = arenaSizeClass(old_size);
+    int new_class = arenaSizeClass(new_size);
+    if (old_class >= 0 && old_class == new_class)
+        return ptr;
+
+    void* res = arenaAlloc(ctx, new_size);
+    if (res == nullptr)
+        return nullptr;
+    memcpy(res, ptr, (old_size < new_size)? old_size : new_size);
+    arenaFree(ctx, ptr, old_size);
+    return res;
+}
+
+const StackAllocator* stackArenaAllocator(StackArena* arena){
+    return &(arena->allocator);
+}
+
+StackArenaStats stackArenaGetStats(const StackArena* arena){
+    return arena->stats;
+}
+
+struct ThreadArenaHolder{
+    StackArena* arena = nullptr;
+    ~ThreadArenaHolder(){
+        stackArenaDestroy(arena);
+    }
+};
+
+StackArena* stackThreadArena(){
+    static thread_local ThreadArenaHolder holder;
+    if (holder.arena == nullptr)
+        holder.arena = stackArenaCreate(0);
+    return holder.arena;
+}
+
+
+#ifdef __linux__
+
+static const int GUARD_MAX_REGIONS = 1024;
+
+//table read by the signal handler, so no locks: a slot is taken by CAS on begin,
+//handler ignores slots whose end is not set yet
+struct GuardRegion{
+    std::atomic<uintptr_t>           begin;
+    std::atomic<uintptr_t>           end;
+    std::atomic<const void*>         owner;
+    std::atomic<stackGuardFaultFn_t> on_fault;
+};
+
+static GuardRegion guard_regions[GUARD_MAX_REGIONS];
+static struct sigaction guard_old_action;
+
+//last fault seen by the handler, read after it by the crash path
+static std::atomic<const void*> guard_fault_owner {nullptr};
+static std::atomic<const void*> guard_fault_addr  {nullptr};
+
+static size_t guardPageSize(){
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    return page;
+}
+
+static size_t guardDataPages(size_t size){
+    size_t page = guardPageSize();
+    return (size == 0)? 1 : (size + page - 1) / page;
+}
+
+//mapping that holds a block: block ends exactly at the start of the upper guard page
+static uint8_t* guardMapBegin(const void* ptr, size_t size){
+    return (uint8_t*)ptr + size - guardDataPages(size) * guardPageSize() - guardPageSize();
+}
+static size_t guardMapSize(size_t size){
+    return (guardDataPages(size) + 2) * guardPageSize();
+}
+
+static GuardRegion* guardFindRegion(uintptr_t addr){
+    for (int i = 0; i < GUARD_MAX_REGIONS; i++){
+        uintptr_t begin = guard_regions[i].begin.load(std::memory_order_acquire);
+        if (begin != 0 && begin <= addr && addr < guard_regions[i].end.load(std::memory_order_acquire))
+            return &guard_regions[i];
+    }
+    return nullptr;
+}
+
+static void guardRegister(uint8_t* map, size_t map_size){
+    for (int i = 0; i < GUARD_MAX_REGIONS; i++){
+        uintptr_t expected = 0;
+        if (guard_regions[i].begin.compare_exchange_strong(expected, (uintptr_t)map)){
+            guard_regions[i].owner   .store(nullptr);
+            guard_regions[i].on_fault.store(nullptr);
+            guard_regions[i].end     .store((uintptr_t)(map + map_size), std::memory_order_release);
+            return;
+        }
+    }
+    //table is full: block is still guarded, only the fault is not reported with a dump
+}
+
+static void guardUnregister(uint8_t* map){
+    GuardRegion* region = guardFindRegion((uintptr_t)map);
+    if (region == nullptr)
+        return;
+    region->end  .store(0);
+    region->owner.store(nullptr);
+    region->begin.store(0, std::memory_order_release);
+}
+
+static void* guardAlloc(void*, size_t size){
+    size_t page     = guardPageSize();
+    size_t map_size = guardMapSize(size);
+    uint8_t* map = (uint8_t*)mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return nullptr;
+
+    //guard pages may be where readable memory was cached by ptr_utils
+    ptrMapsInvalidate();
+    if (mprotect(map, page, PROT_NONE) != 0 || mprotect(map + map_size - page, page, PROT_NONE) != 0){
+        munmap(map, map_size);
+        return nullptr;
+    }
+    guardRegister(map, map_size);
+    return map + map_size - page - size;
+}
+
+static void guardFree(void*, void* ptr, size_t size){
+    if (ptr == nullptr)
+        return;
+    uint8_t* map = guardMapBegin(ptr, size);
+    guardUnregister(map);
+    munmap(map, guardMapSize(size));
+    ptrMapsInvalidate();
+}
+
+static void* guardRealloc(void* ctx, void* ptr, size_t old_size, size_t new_size){
+    void* res = guardAlloc(ctx, new_size);
+    if (res == nullptr || ptr == nullptr)
+        return res;
+    memcpy(res, ptr, (old_size < new_size)? old_size : new_size);
+    guardFree(ctx, ptr, old_size);
+    return res;
+}
+
+const StackAllocator stack_guard_allocator = {guardAlloc, guardRealloc, guardFree, nullptr};
+
+bool stackGuardSetOwner(const void* mem, const void* owner, stackGuardFaultFn_t on_fault){
+    GuardRegion* region = guardFindRegion((uintptr_t)mem);
+    if (region == nullptr)
+        return false;
+    region->owner   .store(owner);
+    region->on_fault.store(on_fault, std::memory_order_release);
+    return true;
+}
+
+//only async-signal-safe work here: lock-free table lookup, atomic stores and the owner's
+//on_fault, which must be signal-safe too. Full dumps are left to the crash path
+static void guardFaultHandler(int, siginfo_t* info, void*){
+    GuardRegion* region = guardFindRegion((uintptr_t)info->si_addr);
+    if (region != nullptr){
+        const void* owner = region->owner.load(std::memory_order_acquire);
+        guard_fault_owner.store(owner);
+        guard_fault_addr .store(info->si_addr, std::memory_order_release);
+        stackGuardFaultFn_t on_fault = region->on_fault.load(std::memory_order_acquire);
+        if (on_fault != nullptr)
+            on_fault(owner, info->si_addr);
+    }
+    //faulting instruction runs again and gets the previous handler (default one crashes)
+    sigaction(SIGSEGV, &guard_old_action, nullptr);
+}
+
+bool stackGuardLastFault(const void** owner, const void** addr){
+    const void* fault_addr = guard_fault_addr.load(std::memory_order_acquire);
+    if (fault_addr == nullptr)
+        return false;
+    if (owner != nullptr)
+        *owner = guard_fault_owner.load();
+    if (addr != nullptr)
+        *addr = fault_addr;
+    return true;
+}
+
+bool stackGuardInstallHandler(){
+    static std::once_flag installed;
+    static bool res = false;
+    std::call_once(installed, [](){
+        struct sigaction action = {};
+        action.sa_sigaction = guardFaultHandler;
+        action.sa_flags     = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        res = (sigaction(SIGSEGV, &action, &guard_old_action) == 0);
+    });
+    return res;
+}
+
+#else
+
+const StackAllocator stack_guard_allocator = stack_malloc_allocator;
+
+bool stackGuardSetOwner(const void*, const void*, stackGuardFaultFn_t){
+    return false;
+}
+
+bool stackGuardLastFault(const void**, const void**){
+    return false;
+}
+
+bool stackGuardInstallHandler(){
+    return false;
+}
+
+#endif
+
+
+#ifdef __linux__
+
+static const size_t LARGE_HUGE_PAGE = 2 << 20;
+static const size_t LARGE_HEADER    = 64; //keeps data cache line aligned
+
+//every mapping starts with a header, block follows it
+struct LargeHeader{
+    size_t map_size;  //whole mapping
+    size_t used_size; //pages after header + used_size are not touched or were released
+};
+
+static size_t largeRoundPages(size_t size){
+    size_t page = guardPageSize();
+    return (size + page - 1) / page * page;
+}
+
+static void largeAdvise(uint8_t* map, size_t map_size){
+    #ifdef MADV_HUGEPAGE
+        if (map_size >= LARGE_HUGE_PAGE)
+            madvise(map, map_size, MADV_HUGEPAGE);
+    #endif
+}
+
+//releases pages that are entirely beyond used part of the block
+static void largeRelease(LargeHeader* head, size_t old_used){
+    size_t keep = largeRoundPages(LARGE_HEADER + head->used_size);
+    size_t end  = largeRoundPages(LARGE_HEADER + old_used);
+    if (end > keep)
+        madvise((uint8_t*)head + keep, end - keep, MADV_DONTNEED);
+}
+
+static void* largeAlloc(void* ctx, size_t size){
+    size_t reserve  = (size_t)ctx;
+    size_t map_size = largeRoundPages(LARGE_HEADER + ((size > reserve)? size : reserve));
+
+    //MAP_NORESERVE: reserved but never touched pages cost nothing
+    uint8_t* map = (uint8_t*)mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+        return nullptr;
+    largeAdvise(map, map_size);
+
+    LargeHeader* head = (LargeHeader*)map;
+    head->map_size  = map_size;
+    head->used_size = size;
+    return map + LARGE_HEADER;
+}
+
+static void largeFree(void*, void* ptr, size_t){
+    if (ptr == nullptr)
+        return;
+    LargeHeader* head = (LargeHeader*)((uint8_t*)ptr - LARGE_HEADER);
+    munmap(head, head->map_size);
+    ptrMapsInvalidate();
+}
+
+static void* largeRealloc(void* ctx, void* ptr, size_t, size_t new_size){
+    if (ptr == nullptr)
+        return largeAlloc(ctx, new_size);
+
+    LargeHeader* head = (LargeHeader*)((uint8_t*)ptr - LARGE_HEADER);
+    size_t old_used = head->used_size;
+    if (LARGE_HEADER + new_size <= head->map_size){
+        head->used_size = new_size;
+        if (new_size < old_used)
+            largeRelease(head, old_used);
+        return ptr;
+    }
+
+    size_t new_map_size = largeRoundPages(LARGE_HEADER + new_size);
+    void* map = mremap(head, head->map_size, new_map_size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED)
+        return nullptr;
+    ptrMapsInvalidate();
+    head = (LargeHeader*)map;
+    head->map_size  = new_map_size;
+    head->used_size = new_size;
+    largeAdvise((uint8_t*)map, new_map_size);
+    return (uint8_t*)map + LARGE_HEADER;
+}
+
+StackAllocator stackLargeAllocator(size_t reserve){
+    return {largeAlloc, largeRealloc, largeFree, (void*)reserve};
+}
+
+#else
+
+StackAllocator stackLargeAllocator(size_t){
+    return stack_malloc_allocator;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef ALLOC_UTILS_H_INCLUDED
+#define ALLOC_UTILS_H_INCLUDED
+
+#include <stddef.h>
+
+//allocator interface used for stack data buffers. alloc and realloc may return uninitialised memory.
+//Sizes passed to realloc/free are the sizes the block was (re)allocated with,
+//so allocator does not have to store them
+struct StackAllocator{
+    void* (*alloc)  (void* ctx, size_t size);
+    void* (*realloc)(void* ctx, void* ptr, size_t old_size, size_t new_size);
+    void  (*free)   (void* ctx, void* ptr, size_t size);
+    void* ctx;
+};
+
+//malloc/realloc/free, default for every stack
+extern const StackAllocator stack_malloc_allocator;
+
+
+//Arena with size-class free lists. Freed blocks are reused by blocks of the same class,
+//stackArenaReset releases everything allocated from the arena at once.
+//Arena is not thread safe, use one per thread (stackThreadArena), stacks using it
+//must not be resized or destroyed on other threads
+struct StackArena;
+
+StackArena*    stackArenaCreate (size_t chunk_size);
+void           stackArenaReset  (StackArena* arena);
+void           stackArenaDestroy(StackArena* arena);
+
+//valid until stackArenaDestroy
+const StackAllocator* stackArenaAllocator(StackArena* arena);
+
+//arena of the calling thread, created on first use and destroyed at thread exit
+StackArena*    stackThreadArena();
+
+struct StackArenaStats{
+    size_t allocs;
+    size_t reused;       //allocations served from a free list
+    size_t large_allocs; //blocks too big for size classes, taken from malloc
+    size_t chunks;
+};
+StackArenaStats stackArenaGetStats(const StackArena* arena);
+
+
+//Guard-page allocator (Linux only): every block is mmap'd between two PROT_NONE pages and
+//right-aligned to the upper one, so writing past the end faults on the first byte.
+//Slack before the block is not guarded, owners keep a canary at its start for underruns.
+//Each block takes at least 3 pages, use it for debugging, not for many small stacks
+#ifdef __linux__
+    const bool stack_guard_pages_supported = true;
+#else
+    const bool stack_guard_pages_supported = false;
+#endif
+
+extern const StackAllocator stack_guard_allocator;
+
+//called from SIGSEGV handler when a guard page of a block owned by owner is accessed, so it
+//must be async-signal-safe (no stdio, malloc or locks, see logSignalWrite).
+//After it returns the handler that was set before is restored and the fault repeats
+typedef void (*stackGuardFaultFn_t)(const void* owner, const void* addr);
+
+//mem must be a block from stack_guard_allocator, returns false if it is not
+bool stackGuardSetOwner(const void* mem, const void* owner, stackGuardFaultFn_t on_fault);
+
+//owner and address of the last guard page fault, false if there was none. For the crash path
+//(the previous SIGSEGV handler, a debugger) to dump the owner outside the guard handler
+bool stackGuardLastFault(const void** owner, const void** addr);
+
+//installs SIGSEGV handler once, returns false if guard pages are not supported
+bool stackGuardInstallHandler();
+
+
+//Large-stack allocator: blocks are separate mappings that grow and shrink with mremap,
+//so data is never copied, unused tail pages are given back with MADV_DONTNEED and
+//transparent huge pages are requested for blocks of 2M and more.
+//With reserve != 0 every block reserves that much address space up front, growth inside
+//the reservation only moves the end. Falls back to malloc/realloc/free where not supported.
+//Returned allocator keeps no state, but must outlive stacks that use it
+StackAllocator stackLargeAllocator(size_t reserve);
+
+#endif // ALLOC_UTILS_H_INCLUDED
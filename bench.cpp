@@ -0,0 +1,799 @@
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stack>
+#include <mutex>
+#include <algorithm>
+#include <string>
+#include <memory>
+#ifdef __linux__
+    #include <unistd.h>
+#endif
+
+#include "Stack.h"
+#include "ConcStack.h"
+#include "StealDeque.h"
+#include "SegStack.h"
+#include "parseArg.h"
+
+//Benchmark driver. Runs every benchmark or only those named on command line: bench bulk alloc conc steal large ...
+//"csv" switches the suite benchmark to CSV output (one header line, one line per measurement)
+
+static double timeSinceMs(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchReport(const char* name, const char* variant, size_t ops, double ms){
+    printf("%-24s %-28s %10zu ops %10.2f ms %8.2f ns/op\n", name, variant, ops, ms, ms * 1e6 / ops);
+}
+
+static const size_t BULK_TOTAL = 1 << 20;
+static const size_t BULK_RUN   = 256;
+
+template<class stack_t>
+static void benchBulk(const char* variant){
+    typedef typename stack_t::elem_type elem_t;
+    static elem_t run[BULK_RUN];
+    for (size_t i = 0; i < BULK_RUN; i++)
+        run[i] = (elem_t)i;
+
+    stack_t stk;
+    stackCtor(&stk);
+    stackSetVerifyPolicy(&stk, {STACK_VERIFY_CHEAP, 0, 0});
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < BULK_TOTAL; done += BULK_RUN)
+        for (size_t i = 0; i < BULK_RUN; i++)
+            stackPush(&stk, run[i]);
+    benchReport("push single", variant, BULK_TOTAL, timeSinceMs(start));
+
+    start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < BULK_TOTAL; done += BULK_RUN)
+        for (size_t i = 0; i < BULK_RUN; i++)
+            run[i] = stackPop(&stk);
+    benchReport("pop single", variant, BULK_TOTAL, timeSinceMs(start));
+
+    start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < BULK_TOTAL; done += BULK_RUN)
+        stackPushN(&stk, run, BULK_RUN);
+    benchReport("pushN (256)", variant, BULK_TOTAL, timeSinceMs(start));
+
+    stack_t copy;
+    stackCtor(&copy);
+    start = std::chrono::steady_clock::now();
+    stackExtend(&copy, &stk);
+    benchReport("extend", variant, BULK_TOTAL, timeSinceMs(start));
+
+    start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < BULK_TOTAL; done += BULK_RUN)
+        stackPopN(&stk, run, BULK_RUN);
+    benchReport("popN (256)", variant, BULK_TOTAL, timeSinceMs(start));
+
+    stackDtor(&copy);
+    stackDtor(&stk);
+}
+
+static const size_t ALLOC_REQUESTS   = 1 << 14;
+static const size_t ALLOC_STACKS     = 64;  //stacks created per request
+static const size_t ALLOC_MAX_ELEMS  = 48;
+
+//most request stacks fit, the rest spill to heap
+struct BenchInlineNone : StackPolicyNone{
+    static constexpr size_t inline_size = 32;
+};
+struct BenchInlineLive : StackPolicyLiveHash{
+    static constexpr size_t inline_size = 32;
+};
+
+//request-handler pattern: many small stacks created and destroyed per request.
+//allocator == nullptr uses default malloc path, otherwise thread arena is reset after each request
+template<class stack_t>
+static void benchAlloc(const char* variant, bool arena){
+    stack_t stacks[ALLOC_STACKS];
+    unsigned int seed = 1;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t req = 0; req < ALLOC_REQUESTS; req++){
+        for (size_t i = 0; i < ALLOC_STACKS; i++){
+            stackCtor(&stacks[i]);
+            stackSetVerifyPolicy(&stacks[i], {STACK_VERIFY_CHEAP, 0, 0});
+            if (arena)
+                stackSetAllocator(&stacks[i], stackArenaAllocator(stackThreadArena()));
+        }
+        for (size_t i = 0; i < ALLOC_STACKS; i++){
+            seed = seed * 1103515245 + 12345;
+            size_t n = (seed >> 16) % ALLOC_MAX_ELEMS + 1;
+            for (size_t j = 0; j < n; j++)
+                stackPush(&stacks[i], (typename stack_t::elem_type)j);
+        }
+        for (size_t i = 0; i < ALLOC_STACKS; i++)
+            stackDtor(&stacks[i]);
+        if (arena)
+            stackArenaReset(stackThreadArena());
+    }
+    benchReport("alloc (stack lifetime)", variant, ALLOC_REQUESTS * ALLOC_STACKS, timeSinceMs(start));
+}
+
+static const size_t CONC_OPS   = 1 << 19; //push/pop pairs, split between threads
+static const size_t CONC_BATCH = 4;       //pushes before pops, so pops find something to take
+
+template<class func_t>
+static double benchRunThreads(unsigned int threads, func_t func){
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < threads; i++)
+        workers.emplace_back(func, i);
+    for (std::thread& worker : workers)
+        worker.join();
+    return timeSinceMs(start);
+}
+
+static unsigned int benchMaxThreads(){
+    unsigned int threads = std::thread::hardware_concurrency();
+    return (threads < 4)? 4 : threads;
+}
+
+template<class stack_t>
+struct BenchLockedStack{
+    std::mutex mutex;
+    stack_t    stk;
+};
+
+//push/pop throughput of a single-threaded stack behind a mutex
+template<class stack_t>
+static void benchLocked(const char* variant, unsigned int threads){
+    typedef typename stack_t::elem_type elem_t;
+    BenchLockedStack<stack_t> locked;
+    stackCtor(&locked.stk);
+
+    size_t per_thread = CONC_OPS / threads;
+    double ms = benchRunThreads(threads, [&](unsigned int){
+        for (size_t i = 0; i < per_thread; i += CONC_BATCH){
+            for (size_t j = 0; j < CONC_BATCH; j++){
+                std::lock_guard<std::mutex> lock(locked.mutex);
+                stackPush(&locked.stk, (elem_t)j);
+            }
+            for (size_t j = 0; j < CONC_BATCH; j++){
+                std::lock_guard<std::mutex> lock(locked.mutex);
+                stackPop(&locked.stk);
+            }
+        }
+    });
+    char name[32] = "";
+    snprintf(name, sizeof(name), "conc push/pop %2u thr", threads);
+    benchReport(name, variant, per_thread * threads * 2, ms);
+    stackDtor(&locked.stk);
+}
+
+template<class conc_t>
+static void benchConc(const char* variant, unsigned int threads){
+    typedef typename conc_t::elem_type elem_t;
+    conc_t stk;
+    stackCtor(&stk);
+
+    size_t per_thread = CONC_OPS / threads;
+    double ms = benchRunThreads(threads, [&](unsigned int){
+        for (size_t i = 0; i < per_thread; i += CONC_BATCH){
+            for (size_t j = 0; j < CONC_BATCH; j++)
+                stackPush(&stk, (elem_t)j);
+            for (size_t j = 0; j < CONC_BATCH; j++)
+                stackPop(&stk);
+        }
+    });
+    char name[32] = "";
+    snprintf(name, sizeof(name), "conc push/pop %2u thr", threads);
+    benchReport(name, variant, per_thread * threads * 2, ms);
+
+    StackStats stats = {};
+    if (conc_t::elimination && stackGetStats(&stk, &stats) == STACK_NOERROR)
+        printf("%-24s %-28s %10zu central %10zu eliminated\n", "", "", stats.central, stats.eliminated);
+    stackDtor(&stk);
+}
+
+struct BenchElimPolicy : StackPolicyNone{
+    static constexpr bool stats       = true;
+    static constexpr bool elimination = true;
+};
+
+//Fork/join scheduler on work-stealing deques: each worker runs tasks from its own deque
+//and steals from a random victim when it is empty. Task fib(n) forks fib(n-1) and fib(n-2),
+//small n are computed serially and summed per worker, so no joins are needed
+static const int FIB_N      = 38;
+static const int FIB_CUTOFF = 18;
+
+static long fibSerial(int n){
+    return (n < 2)? n : fibSerial(n - 1) + fibSerial(n - 2);
+}
+
+static size_t fibTasks(int n){
+    return (n < FIB_CUTOFF)? 1 : 1 + fibTasks(n - 1) + fibTasks(n - 2);
+}
+
+template<class deque_t>
+struct BenchScheduler{
+    std::vector<deque_t> deques;
+    std::vector<long>    sums;
+    std::atomic<long>    pending;
+
+    explicit BenchScheduler(unsigned int threads): deques(threads), sums(threads * 8){}
+};
+
+template<class deque_t>
+static void benchSchedulerWorker(BenchScheduler<deque_t>* sched, unsigned int id){
+    deque_t* own  = &(sched->deques[id]);
+    unsigned int threads = sched->deques.size();
+    unsigned int seed    = id * 2654435761u + 1;
+    long sum = 0;
+
+    while (sched->pending.load(std::memory_order_acquire) > 0){
+        stackError_t err = STACK_NOERROR;
+        int n = stackPop(own, &err);
+        if (err != STACK_NOERROR){
+            seed = seed * 1103515245 + 12345;
+            err  = STACK_NOERROR;
+            n    = stackSteal(&(sched->deques[(seed >> 16) % threads]), &err);
+            if (err != STACK_NOERROR){
+                std::this_thread::yield();
+                continue;
+            }
+        }
+
+        if (n < FIB_CUTOFF){
+            sum += fibSerial(n);
+            sched->pending.fetch_sub(1, std::memory_order_release);
+        }
+        else{
+            sched->pending.fetch_add(1, std::memory_order_relaxed); //two tasks instead of one
+            stackPush(own, n - 1);
+            stackPush(own, n - 2);
+        }
+    }
+    sched->sums[id * 8] = sum; //one cache line per worker
+}
+
+template<class deque_t>
+static void benchSteal(const char* variant, unsigned int threads){
+    BenchScheduler<deque_t> sched(threads);
+    for (deque_t& deq : sched.deques)
+        stackCtor(&deq);
+
+    sched.pending.store(1);
+    stackPush(&(sched.deques[0]), FIB_N);
+    double ms = benchRunThreads(threads, [&](unsigned int id){
+        benchSchedulerWorker(&sched, id);
+    });
+
+    long sum = 0;
+    for (unsigned int i = 0; i < threads; i++)
+        sum += sched.sums[i * 8];
+    if (sum != fibSerial(FIB_N))
+        printf("fib(%d) = %ld, expected %ld\n", FIB_N, sum, fibSerial(FIB_N));
+
+    char name[32] = "";
+    snprintf(name, sizeof(name), "fib(%d) %2u thr", FIB_N, threads);
+    benchReport(name, variant, fibTasks(FIB_N), ms);
+    for (deque_t& deq : sched.deques)
+        stackDtor(&deq);
+}
+
+static const size_t LARGE_ELEMS   = 32 << 20; //128M of ints
+static const size_t LARGE_RESERVE = 1ull << 30;
+
+//resident set size in megabytes, 0 if not known
+static double benchRssMb(){
+    double rss = 0;
+    #ifdef __linux__
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (statm != nullptr){
+            size_t pages = 0, resident = 0;
+            if (fscanf(statm, "%zu %zu", &pages, &resident) == 2)
+                rss = resident * (double)sysconf(_SC_PAGESIZE) / (1 << 20);
+            fclose(statm);
+        }
+    #endif
+    return rss;
+}
+
+//next push allocates or reallocates data
+template<typename elem_t, class policy_t, class traits_t>
+static bool benchPushGrows(const StackT<elem_t, policy_t, traits_t>* stk){
+    return stk->size == stk->capacity;
+}
+template<typename elem_t, class policy_t, class traits_t>
+static bool benchPushGrows(const SegStackT<elem_t, policy_t, traits_t>* stk){
+    return segStackTopFull(stk) && stk->spare == nullptr;
+}
+
+//growth of a huge stack: total time, worst single push (the resize) and memory after pop
+template<class stack_t>
+static void benchLarge(const char* variant, const StackAllocator* allocator){
+    typedef typename stack_t::elem_type elem_t;
+    stack_t stk;
+    stackCtor(&stk);
+    if (allocator != nullptr)
+        stackSetAllocator(&stk, allocator);
+    double rss_before = benchRssMb();
+
+    double worst_ms = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LARGE_ELEMS; i++){
+        if (benchPushGrows(&stk)){
+            auto push_start = std::chrono::steady_clock::now();
+            stackPush(&stk, (elem_t)i);
+            double push_ms = timeSinceMs(push_start);
+            if (push_ms > worst_ms)
+                worst_ms = push_ms;
+        }
+        else{
+            stackPush(&stk, (elem_t)i);
+        }
+    }
+    benchReport("large push", variant, LARGE_ELEMS, timeSinceMs(start));
+    double rss_full = benchRssMb();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LARGE_ELEMS; i++)
+        stackPop(&stk);
+    benchReport("large pop", variant, LARGE_ELEMS, timeSinceMs(start));
+
+    printf("%-24s %-28s worst push %8.2f ms, rss full %7.1f M, after pop %7.1f M\n", "", "",
+           worst_ms, rss_full - rss_before, benchRssMb() - rss_before);
+    stackDtor(&stk);
+}
+
+static const size_t ELEM_OPS = 1 << 18;
+
+static std::string             benchMakeString(size_t i){ return std::string(32 + i % 32, (char)('a' + i % 26)); }
+static std::unique_ptr<size_t> benchMakeUnique(size_t i){ return std::make_unique<size_t>(i); }
+
+//elements with destructors: std::string is moved one by one on resize, unique_ptr still goes through realloc
+template<class stack_t>
+static void benchElemType(const char* variant, typename stack_t::elem_type (*make)(size_t)){
+    stack_t stk;
+    stackCtor(&stk);
+    stackSetVerifyPolicy(&stk, {STACK_VERIFY_CHEAP, 0, 0});
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ELEM_OPS; i++)
+        stackPush(&stk, make(i));
+    benchReport("push (moved in)", variant, ELEM_OPS, timeSinceMs(start));
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ELEM_OPS; i++)
+        stackPop(&stk);
+    benchReport("pop (moved out)", variant, ELEM_OPS, timeSinceMs(start));
+    stackDtor(&stk);
+}
+
+//protected stacks check stk and data pointers on every operation
+static const size_t PTR_OPS = 1 << 18;
+
+static void benchPtr(const char* variant, ptrCheckMode_t mode){
+    ptrCheckMode_t old_mode = getPtrCheckMode();
+    setPtrCheckMode(mode);
+
+    StackT<int, StackPolicyLiveHash> stk;
+    stackCtor(&stk);
+    //stack stays shallow: full checks rescan the live hash too
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < PTR_OPS; i++){
+        stackPush(&stk, (int)i);
+        stackPop(&stk);
+    }
+    benchReport("checked push/pop", variant, PTR_OPS, timeSinceMs(start));
+    stackDtor(&stk);
+
+    setPtrCheckMode(old_mode);
+}
+
+//verify levels on a live-hash stack: cost of an op, and checks until a slot below the top
+//that was overwritten is found (sampled levels find it after every_n_ops checks at most)
+static const size_t VERIFY_OPS   = 1 << 16;
+static const size_t VERIFY_DEPTH = 1024;
+
+static void benchVerify(const char* variant, StackVerifyPolicy policy){
+    StackT<int, StackPolicyLiveHash> stk;
+    stackCtor(&stk);
+    stackSetVerifyPolicy(&stk, policy);
+    for (size_t i = 0; i < VERIFY_DEPTH; i++)
+        stackPush(&stk, (int)i);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < VERIFY_OPS; i++){
+        stackPush(&stk, (int)i);
+        stackPop(&stk);
+    }
+    benchReport("verified push/pop", variant, VERIFY_OPS, timeSinceMs(start));
+
+    stk.data[VERIFY_DEPTH / 2]++;
+    size_t checks = 1;
+    while (checks <= VERIFY_OPS && !(stackCheck(&stk) & STACK_DATA_HASH_BAD))
+        checks++;
+    if (checks <= VERIFY_OPS)
+        printf("%-24s %-28s corrupted slot found by check %zu\n", "", variant, checks);
+    else
+        printf("%-24s %-28s corrupted slot not found in %zu checks\n", "", variant, VERIFY_OPS);
+    stk.data[VERIFY_DEPTH / 2]--;
+    stackDtor(&stk);
+}
+
+//array of stacks, one per thread: neighbours share cache lines unless stacks are cache-aligned
+static const size_t ARRAY_OPS = 1 << 21; //push/pop pairs per thread
+
+struct BenchAlignedPolicy : StackPolicyNone{
+    static constexpr size_t align = STACK_CACHE_LINE;
+};
+
+template<class stack_t>
+static void benchArray(const char* variant, unsigned int threads){
+    std::vector<stack_t> stacks(threads);
+    for (stack_t& stk : stacks)
+        stackCtor(&stk);
+
+    static volatile int sink = 0;
+    double ms = benchRunThreads(threads, [&](unsigned int index){
+        stack_t* stk = &stacks[index];
+        for (size_t i = 0; i < ARRAY_OPS; i++){
+            stackPush(stk, (int)i);
+            sink = sink + stackPop(stk);
+        }
+    });
+    char name[64] = "";
+    snprintf(name, sizeof(name), "%s, %u threads", variant, threads);
+    benchReport("stack per thread", name, ARRAY_OPS * threads, ms);
+
+    for (stack_t& stk : stacks)
+        stackDtor(&stk);
+}
+
+//caller-side cost of logging; run with stderr redirected
+static const size_t LOG_DUMPS        = 16;
+static const size_t LOG_DUMP_ELEMS   = 1024;
+static const size_t LOG_FILTERED_OPS = 1 << 24;
+static const size_t LOG_STAMP_OPS    = 1 << 20;
+
+static void benchLogDumps(const char* variant, const StackDumpOptions* opt){
+    StackT<int, StackPolicyNone> stk;
+    stackCtor(&stk);
+    for (size_t i = 0; i < LOG_DUMP_ELEMS; i++)
+        stackPush(&stk, (int)i);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LOG_DUMPS; i++)
+        stackDump(&stk, opt);
+    benchReport("stackDump (1024 elems)", variant, LOG_DUMPS, timeSinceMs(start));
+    logFlush();
+    stackDtor(&stk);
+}
+
+static void benchLog(){
+    benchLogDumps("sync, all slots"         , &stack_dump_all);
+    benchLogDumps("sync, default windows"   , &stack_default_dump_options);
+    logStartAsync();
+    benchLogDumps("async, all slots"        , &stack_dump_all);
+    benchLogDumps("async, default windows"  , &stack_default_dump_options);
+    logStartBinary("bench_log.bin");
+    benchLogDumps("async binary, all slots" , &stack_dump_all);
+    logStopBinary();
+    logStopAsync();
+
+    logLevel_t old_level = _log_level;
+    setLogLevel(LOG_LEVEL_INFO);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LOG_FILTERED_OPS; i++)
+        debug_log("filtered %zu\n", i);
+    benchReport("debug_log", "filtered at runtime", LOG_FILTERED_OPS, timeSinceMs(start));
+    setLogLevel(old_level);
+
+    char stamp[TIMESTAMP_LEN + 1] = {};
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LOG_STAMP_OPS; i++)
+        sprint_time_nodate(stamp, sizeof(stamp), time(nullptr));
+    benchReport("log timestamp", "localtime every call", LOG_STAMP_OPS, timeSinceMs(start));
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LOG_STAMP_OPS; i++)
+        sprint_timestamp(stamp, sizeof(stamp));
+    benchReport("log timestamp", "cached second + monotonic", LOG_STAMP_OPS, timeSinceMs(start));
+}
+
+//Suite: every op on every protection level (same as Stack built with the macros), element size and
+//depth, std::vector and std::stack as baselines. Throughput from a timed loop, latency percentiles
+//from a second pass that times each op (bulk: each pushN/popN call), minus clock overhead
+static const size_t SUITE_OPS        = 1 << 16;
+static const size_t SUITE_MIN_OPS    = 16;
+static const size_t SUITE_BUDGET     = (size_t)1 << 26; //bytes hashed/scanned per pass for O(n) checks
+static const size_t SUITE_BULK       = 256;
+static const size_t SUITE_DEPTHS[]   = {16, 1024, 65536};
+
+struct SuitePolicyNoProtect : StackPolicyNone{};      //NDEBUG / STACK_NO_PROTECT
+struct SuitePolicyNoHash    : StackPolicyFull{        //STACK_NO_HASH
+    static constexpr bool hash   = false;
+};
+struct SuitePolicyNoCanary  : StackPolicyFull{        //STACK_NO_CANARY
+    static constexpr bool canary = false;
+};
+struct SuitePolicyLiveHash  : StackPolicyLiveHash{};  //STACK_HASH_LIVE
+
+template<size_t elem_size>
+struct BenchElem{
+    uint8_t bytes[elem_size];
+    BenchElem() = default;
+    explicit BenchElem(size_t value){ memset(bytes, (int)value, elem_size); }
+};
+
+template<class stack_t>
+struct SuiteStack{
+    typedef typename stack_t::elem_type elem_t;
+    //data is rescanned on every op by the full check, live hash too
+    static constexpr bool linear = stack_t::hash;
+
+    stack_t stk;
+    void   init()                           { stackCtor(&stk); }
+    void   destroy()                        { stackDtor(&stk); }
+    void   push (const elem_t& elem)        { stackPush(&stk, elem); }
+    elem_t pop  ()                          { return stackPop(&stk); }
+    elem_t top  ()                          { return stackTop(&stk); }
+    void   pushN(const elem_t* elems, size_t n){ stackPushN(&stk, elems, n); }
+    void   popN (elem_t* out, size_t n)     { stackPopN(&stk, out, n); }
+    size_t size ()                          { return stk.size; }
+};
+
+template<typename elem_t>
+struct SuiteVector{
+    static constexpr bool linear = false;
+
+    std::vector<elem_t> vec;
+    void   init()                           {}
+    void   destroy()                        { std::vector<elem_t>().swap(vec); }
+    void   push (const elem_t& elem)        { vec.push_back(elem); }
+    elem_t pop  ()                          { elem_t elem = vec.back(); vec.pop_back(); return elem; }
+    elem_t top  ()                          { return vec.back(); }
+    void   pushN(const elem_t* elems, size_t n){ vec.insert(vec.end(), elems, elems + n); }
+    void   popN (elem_t* out, size_t n)     { std::copy(vec.end() - n, vec.end(), out); vec.resize(vec.size() - n); }
+    size_t size ()                          { return vec.size(); }
+};
+
+template<typename elem_t>
+struct SuiteStdStack{
+    static constexpr bool linear = false;
+
+    std::stack<elem_t> stk;
+    void   init()                           {}
+    void   destroy()                        { std::stack<elem_t>().swap(stk); }
+    void   push (const elem_t& elem)        { stk.push(elem); }
+    elem_t pop  ()                          { elem_t elem = stk.top(); stk.pop(); return elem; }
+    elem_t top  ()                          { return stk.top(); }
+    void   pushN(const elem_t* elems, size_t n){ for (size_t i = 0; i < n; i++) stk.push(elems[i]); }
+    void   popN (elem_t* out, size_t n)     { for (size_t i = 0; i < n; i++){ out[i] = stk.top(); stk.pop(); } }
+    size_t size ()                          { return stk.size(); }
+};
+
+static bool   suite_csv = false;
+static double suite_clock_ns = 0;
+
+typedef std::chrono::steady_clock::time_point benchTime_t;
+
+static double suiteNs(benchTime_t start, benchTime_t end){
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+//cheapest back-to-back clock read, subtracted from each timed op
+static void suiteCalibrateClock(){
+    double best = 1e9;
+    for (int i = 0; i < 10000; i++){
+        benchTime_t start = std::chrono::steady_clock::now();
+        benchTime_t end   = std::chrono::steady_clock::now();
+        best = std::min(best, suiteNs(start, end));
+    }
+    suite_clock_ns = best;
+}
+
+struct SuiteResult{
+    size_t ops;
+    double ns_per_op;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+static double suitePercentile(const std::vector<double>& sorted, double fraction){
+    return sorted[std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+static void suiteReport(const char* container, const char* policy, size_t elem_size, size_t depth,
+                        const char* op, const SuiteResult& res){
+    if (suite_csv){
+        printf("%s,%s,%zu,%zu,%s,%zu,%.3f,%.1f,%.1f,%.1f,%.1f\n", container, policy, elem_size, depth, op,
+               res.ops, res.ns_per_op, res.p50, res.p99, res.p999, res.max);
+    }
+    else{
+        printf("%-12s %-12s %4zu B %6zu deep %-6s %8zu ops %9.2f ns/op   p50 %8.1f p99 %9.1f p99.9 %9.1f max %10.1f ns\n",
+               container, policy, elem_size, depth, op, res.ops, res.ns_per_op, res.p50, res.p99, res.p999, res.max);
+    }
+    fflush(stdout);
+}
+
+//op_fn(ops, i) does op number i. Runs ops twice: whole loop timed, then each op timed.
+//reset_fn() brings container back to the starting depth between passes
+template<class op_fn_t, class reset_fn_t>
+static SuiteResult suiteMeasure(size_t ops, size_t ops_per_call, op_fn_t op_fn, reset_fn_t reset_fn){
+    SuiteResult res = {};
+    size_t calls = std::max((size_t)1, ops / ops_per_call);
+    res.ops = calls * ops_per_call;
+
+    benchTime_t start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; i++)
+        op_fn(i);
+    res.ns_per_op = suiteNs(start, std::chrono::steady_clock::now()) / res.ops;
+    reset_fn();
+
+    std::vector<double> lat(calls);
+    for (size_t i = 0; i < calls; i++){
+        benchTime_t op_start = std::chrono::steady_clock::now();
+        op_fn(i);
+        lat[i] = std::max(0.0, suiteNs(op_start, std::chrono::steady_clock::now()) - suite_clock_ns) / ops_per_call;
+    }
+    reset_fn();
+
+    std::sort(lat.begin(), lat.end());
+    res.p50  = suitePercentile(lat, 0.5);
+    res.p99  = suitePercentile(lat, 0.99);
+    res.p999 = suitePercentile(lat, 0.999);
+    res.max  = lat.back();
+    return res;
+}
+
+template<class suite_t, typename elem_t>
+static void suiteRun(const char* container, const char* policy, size_t depth){
+    //keeps popped values alive; first byte is enough for any element type
+    static volatile uint8_t sink = 0;
+    auto use = [](const elem_t& elem){ sink = sink + *(const uint8_t*)&elem; };
+
+    size_t ops = SUITE_OPS;
+    if (suite_t::linear)
+        ops = std::max(SUITE_MIN_OPS, std::min(ops, SUITE_BUDGET / ((depth + ops) * sizeof(elem_t))));
+    //bulk ops do at least one full call
+    size_t bulk_ops = std::max(ops, SUITE_BULK) / SUITE_BULK * SUITE_BULK;
+
+    static elem_t run[SUITE_BULK];
+    static elem_t scratch[SUITE_BULK];
+    for (size_t i = 0; i < SUITE_BULK; i++)
+        run[i] = (elem_t)i;
+    //mixed: push or pop by a fixed pseudo-random pattern, never below the starting depth - 1
+    std::vector<uint8_t> pattern(ops);
+    uint32_t rnd = 12345;
+    for (size_t i = 0; i < ops; i++){
+        rnd = rnd * 1103515245 + 12345;
+        pattern[i] = (rnd >> 16) & 1;
+    }
+
+    suite_t cont;
+    cont.init();
+
+    //resets go in bulk so a full check runs once per SUITE_BULK elements, not once per element
+    auto toDepth = [&](){
+        while (cont.size() > depth) cont.popN (scratch, std::min(cont.size() - depth, SUITE_BULK));
+        while (cont.size() < depth) cont.pushN(run    , std::min(depth - cont.size(), SUITE_BULK));
+    };
+    auto fill = [&](){
+        toDepth();
+        for (size_t i = 0; i < bulk_ops; i += SUITE_BULK) cont.pushN(run, SUITE_BULK);
+    };
+
+    fill();
+    suiteReport(container, policy, sizeof(elem_t), depth, "pop",
+                suiteMeasure(ops, 1, [&](size_t){ use(cont.pop()); }, fill));
+    toDepth();
+    suiteReport(container, policy, sizeof(elem_t), depth, "push",
+                suiteMeasure(ops, 1, [&](size_t i){ cont.push(run[i % SUITE_BULK]); }, toDepth));
+    suiteReport(container, policy, sizeof(elem_t), depth, "top",
+                suiteMeasure(ops, 1, [&](size_t){ use(cont.top()); }, toDepth));
+    suiteReport(container, policy, sizeof(elem_t), depth, "mixed",
+                suiteMeasure(ops, 1, [&](size_t i){
+                    if (pattern[i] || cont.size() < depth) cont.push(run[i % SUITE_BULK]);
+                    else                                  use(cont.pop());
+                }, toDepth));
+    suiteReport(container, policy, sizeof(elem_t), depth, "pushN",
+                suiteMeasure(bulk_ops, SUITE_BULK, [&](size_t){ cont.pushN(run, SUITE_BULK); }, toDepth));
+    fill();
+    suiteReport(container, policy, sizeof(elem_t), depth, "popN",
+                suiteMeasure(bulk_ops, SUITE_BULK, [&](size_t){ cont.popN(scratch, SUITE_BULK); }, fill));
+
+    cont.destroy();
+}
+
+template<typename elem_t>
+static void suiteElem(size_t depth){
+    suiteRun<SuiteStack<StackT<elem_t, SuitePolicyNoProtect>>, elem_t>("Stack", "no_protect", depth);
+    suiteRun<SuiteStack<StackT<elem_t, SuitePolicyNoHash   >>, elem_t>("Stack", "no_hash"   , depth);
+    suiteRun<SuiteStack<StackT<elem_t, SuitePolicyNoCanary >>, elem_t>("Stack", "no_canary" , depth);
+    suiteRun<SuiteStack<StackT<elem_t, SuitePolicyLiveHash >>, elem_t>("Stack", "live_hash" , depth);
+    suiteRun<SuiteStack<StackT<elem_t, StackPolicyFull     >>, elem_t>("Stack", "full"      , depth);
+    suiteRun<SuiteVector  <elem_t>, elem_t>("std::vector", "-", depth);
+    suiteRun<SuiteStdStack<elem_t>, elem_t>("std::stack" , "-", depth);
+}
+
+static void benchSuite(){
+    suiteCalibrateClock();
+    if (suite_csv)
+        printf("container,policy,elem_size,depth,op,ops,ns_per_op,p50_ns,p99_ns,p999_ns,max_ns\n");
+    for (size_t depth : SUITE_DEPTHS){
+        suiteElem<int           >(depth);
+        suiteElem<long long     >(depth);
+        suiteElem<BenchElem<64> >(depth);
+    }
+}
+
+static bool benchSelected(int argc, const char* argv[], const char* name){
+    return argc <= 1 || parseArg(argc, argv, name) != ARG_NOT_FOUND;
+}
+
+int main(int argc, const char* argv[]){
+    if (benchSelected(argc, argv, "bulk")){
+        benchBulk<StackT<int, StackPolicyNone    >>("int, no protection");
+        benchBulk<StackT<int, StackPolicyLiveHash>>("int, live hash");
+        benchBulk<StackT<int, StackPolicyGuard   >>("int, guard pages");
+    }
+    if (benchSelected(argc, argv, "alloc")){
+        benchAlloc<StackT<int, StackPolicyNone    >>("no protection, malloc", false);
+        benchAlloc<StackT<int, StackPolicyNone    >>("no protection, arena" , true );
+        benchAlloc<StackT<int, StackPolicyLiveHash>>("live hash, malloc"    , false);
+        benchAlloc<StackT<int, StackPolicyLiveHash>>("live hash, arena"     , true );
+        benchAlloc<StackT<int, BenchInlineNone    >>("no protection, inline", false);
+        benchAlloc<StackT<int, BenchInlineLive    >>("live hash, inline"    , false);
+    }
+    if (benchSelected(argc, argv, "conc")){
+        for (unsigned int threads = 1; threads <= benchMaxThreads(); threads *= 2){
+            benchLocked<StackT    <int, StackPolicyNone>>("mutex + Stack, no protection", threads);
+            benchConc  <ConcStackT<int, StackPolicyNone>>("lock-free, no protection"    , threads);
+            benchConc  <ConcStackT<int, StackPolicyFull>>("lock-free, node canary+hash" , threads);
+            benchConc  <ConcStackT<int, BenchElimPolicy>>("lock-free, elimination"      , threads);
+        }
+    }
+    if (benchSelected(argc, argv, "large")){
+        StackAllocator large    = stackLargeAllocator(0);
+        StackAllocator reserved = stackLargeAllocator(LARGE_RESERVE);
+        benchLarge<StackT<int, StackPolicyNone>>("malloc/realloc"     , nullptr);
+        benchLarge<StackT<int, StackPolicyNone>>("mremap"             , &large);
+        benchLarge<StackT<int, StackPolicyNone>>("reserved 1G"        , &reserved);
+        benchLarge<SegStackT<int, StackPolicyNone>>("segmented"        , nullptr);
+    }
+    if (benchSelected(argc, argv, "steal")){
+        for (unsigned int threads = 1; threads <= benchMaxThreads(); threads *= 2){
+            benchSteal<StealDequeT<int, StackPolicyNone>>("work stealing, no protection", threads);
+            benchSteal<StealDequeT<int, StackPolicyFull>>("work stealing, canaries"     , threads);
+        }
+    }
+    if (benchSelected(argc, argv, "ptr")){
+        benchPtr("pointer check off"     , PTR_CHECK_OFF    );
+        benchPtr("pointer check system"  , PTR_CHECK_SYSTEM );
+        benchPtr("pointer check tracked" , PTR_CHECK_TRACKED);
+        benchPtr("pointer check probe"   , PTR_CHECK_PROBE  );
+    }
+    if (benchSelected(argc, argv, "verify")){
+        benchVerify("cheap"                , {STACK_VERIFY_CHEAP  , 0 , 0});
+        benchVerify("sampled every 64 ops" , {STACK_VERIFY_SAMPLED, 64, 0});
+        benchVerify("full"                 , {STACK_VERIFY_FULL   , 0 , 0});
+    }
+    if (benchSelected(argc, argv, "elem")){
+        benchElemType<StackT<std::string            , StackPolicyNone    >>("string, no protection"    , benchMakeString);
+        benchElemType<StackT<std::string            , StackPolicyLiveHash>>("string, live hash"        , benchMakeString);
+        benchElemType<StackT<std::unique_ptr<size_t>, StackPolicyNone    >>("unique_ptr, no protection", benchMakeUnique);
+        benchElemType<StackT<std::unique_ptr<size_t>, StackPolicyLiveHash>>("unique_ptr, live hash"    , benchMakeUnique);
+    }
+    if (benchSelected(argc, argv, "align")){
+        for (unsigned int threads = 1; threads <= benchMaxThreads(); threads *= 2){
+            benchArray<StackT<int, StackPolicyNone   >>("natural"      , threads);
+            benchArray<StackT<int, BenchAlignedPolicy>>("cache aligned", threads);
+        }
+    }
+    if (benchSelected(argc, argv, "log"))
+        benchLog();
+    if (benchSelected(argc, argv, "suite")){
+        suite_csv = (parseArg(argc, argv, "csv") != ARG_NOT_FOUND);
+        benchSuite();
+    }
+    return 0;
+}
@@ -1,3 +1,17 @@
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <nmmintrin.h>
+    #define HASH_HAVE_SSE42_DISPATCH
+#endif
+
 #include "debug_utils.h"
 
 const char* varstatusAsString(variableStatus_t var){
@@ -23,18 +37,443 @@ const char* strPrintable(const char* str){
 }
 
 bool checkLCanary(const void* ptr){
-    return ((canary_t*)ptr)[-1]     == CANARY_L;
+    return getLCanary(ptr) == CANARY_L;
+}
+
+void setLCanary(void* ptr){
+    memcpy((char*)ptr - sizeof(canary_t), &CANARY_L, sizeof(canary_t));
+}
+
+canary_t getLCanary(const void* ptr){
+    canary_t canary = 0;
+    memcpy(&canary, (const char*)ptr - sizeof(canary_t), sizeof(canary_t));
+    return canary;
 }
 
 bool checkRCanary(const void* ptr, size_t len){
-    return ((canary_t*)((char*)ptr+len))[0] == CANARY_R;
+    return getRCanary(ptr, len) == CANARY_R;
+}
+
+void setRCanary(void* ptr, size_t len){
+    memcpy((char*)ptr + len, &CANARY_R, sizeof(canary_t));
 }
 
+canary_t getRCanary(const void* ptr, size_t len){
+    canary_t canary = 0;
+    memcpy(&canary, (const char*)ptr + len, sizeof(canary_t));
+    return canary;
+}
+
+static const hash_t GNU_HASH_MULT = 33;
+
 hash_t gnuHash(const void* begin_ptr, const void* end_ptr){
-    hash_t hash = HASH_DEFAULT;
+    return gnuHashAppend(HASH_DEFAULT, begin_ptr, end_ptr);
+}
+
+hash_t gnuHashAppend(hash_t hash, const void* begin_ptr, const void* end_ptr){
     while(begin_ptr < end_ptr){
-        hash = (hash * 33) + (*(uint8_t*)begin_ptr);
+        hash = (hash * GNU_HASH_MULT) + (*(uint8_t*)begin_ptr);
         begin_ptr = (uint8_t*)begin_ptr + 1;
     }
     return hash;
 }
+
+hash_t gnuHashPow(size_t len){
+    hash_t res  = 1;
+    hash_t base = GNU_HASH_MULT;
+    while(len){
+        if (len & 1)
+            res *= base;
+        base *= base;
+        len >>= 1;
+    }
+    return res;
+}
+
+hash_t gnuHashPowInv(size_t len){
+    hash_t pow = gnuHashPow(len);
+    hash_t inv = pow;           // correct in lower 3 bits for any odd number
+    for (int i = 0; i < 5; i++) // newton iteration, each step doubles correct bits
+        inv *= 2 - pow * inv;
+    return inv;
+}
+
+hash_t gnuHashFast(const void* begin_ptr, const void* end_ptr){
+    return gnuHashAppendFast(HASH_DEFAULT, begin_ptr, end_ptr);
+}
+
+//b[0]*33^7 + b[1]*33^6 + ... + b[7] for 8 bytes loaded as one word,
+//lanes are combined pairwise (SWAR) so it takes 3 multiplications instead of 8
+static inline hash_t gnuHashWord(uint64_t word){
+    #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+    #endif
+    const uint64_t lanes8  = 0x00FF00FF00FF00FF;
+    const uint64_t lanes16 = 0x0000FFFF0000FFFF;
+    uint64_t pairs = (word  & lanes8 ) *  33                 + ((word  >>  8) & lanes8 );
+    uint64_t quads = (pairs & lanes16) * (33 * 33)           + ((pairs >> 16) & lanes16);
+    return           (quads & 0xFFFFFFFF) * (33 * 33 * 33 * 33) + (quads >> 32);
+}
+
+hash_t gnuHashAppendFast(hash_t hash, const void* begin_ptr, const void* end_ptr){
+    const uint8_t* ptr = (const uint8_t*)begin_ptr;
+    const uint8_t* end = (const uint8_t*)end_ptr;
+
+    static const hash_t pow8  = gnuHashPow(8);
+    static const hash_t pow16 = gnuHashPow(16);
+    static const hash_t pow24 = gnuHashPow(24);
+    static const hash_t pow32 = gnuHashPow(32);
+
+    while (end - ptr >= 32){
+        uint64_t words[4];
+        memcpy(words, ptr, sizeof(words));
+        hash = hash * pow32 + gnuHashWord(words[0]) * pow24 + gnuHashWord(words[1]) * pow16
+                            + gnuHashWord(words[2]) * pow8  + gnuHashWord(words[3]);
+        ptr += 32;
+    }
+    while (end - ptr >= 8){
+        uint64_t word = 0;
+        memcpy(&word, ptr, sizeof(word));
+        hash = hash * pow8 + gnuHashWord(word);
+        ptr += 8;
+    }
+    return gnuHashAppend(hash, ptr, end);
+}
+
+static const uint32_t CRC32C_POLY = 0x82F63B78; //reflected
+
+struct Crc32cTable{
+    uint32_t entry[256];
+};
+
+static constexpr Crc32cTable crc32cMakeTable(){
+    Crc32cTable table = {};
+    for (uint32_t i = 0; i < 256; i++){
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+        table.entry[i] = crc;
+    }
+    return table;
+}
+
+//built at compile time, so hash threads never race on its initialisation
+static constexpr Crc32cTable crc32c_table = crc32cMakeTable();
+
+static uint32_t crc32cSoft(uint32_t crc, const uint8_t* ptr, const uint8_t* end){
+    while (ptr < end){
+        crc = (crc >> 8) ^ crc32c_table.entry[(crc ^ *ptr) & 0xFF];
+        ptr++;
+    }
+    return crc;
+}
+
+#ifdef HASH_HAVE_SSE42_DISPATCH
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHw(uint32_t crc, const uint8_t* ptr, const uint8_t* end){
+    #ifdef __x86_64__
+        uint64_t crc64 = crc;
+        while (end - ptr >= 8){
+            uint64_t word = 0;
+            memcpy(&word, ptr, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+            ptr += 8;
+        }
+        crc = (uint32_t)crc64;
+    #endif
+    while (end - ptr >= 4){
+        uint32_t word = 0;
+        memcpy(&word, ptr, 4);
+        crc = _mm_crc32_u32(crc, word);
+        ptr += 4;
+    }
+    while (ptr < end){
+        crc = _mm_crc32_u8(crc, *ptr);
+        ptr++;
+    }
+    return crc;
+}
+
+#endif
+
+static bool cpuHasSse42(){
+    #ifdef HASH_HAVE_SSE42_DISPATCH
+        //may run before constructors that would init cpu model
+        __builtin_cpu_init();
+        static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+        return has_sse42;
+    #else
+        return false;
+    #endif
+}
+
+//continues crc32c of previous bytes with the region (initial and final xor ~0)
+static uint32_t crc32cAppend(uint32_t crc, const void* begin_ptr, const void* end_ptr){
+    const uint8_t* ptr = (const uint8_t*)begin_ptr;
+    const uint8_t* end = (const uint8_t*)end_ptr;
+    crc = ~crc;
+    #ifdef HASH_HAVE_SSE42_DISPATCH
+    if (cpuHasSse42())
+        crc = crc32cHw(crc, ptr, end);
+    else
+    #endif
+        crc = crc32cSoft(crc, ptr, end);
+    return ~crc;
+}
+
+static uint32_t crc32c(const void* begin_ptr, const void* end_ptr){
+    return crc32cAppend(0, begin_ptr, end_ptr);
+}
+
+static uint32_t gf2MatrixTimes(const uint32_t* mat, uint32_t vec){
+    uint32_t sum = 0;
+    for (; vec != 0; vec >>= 1, mat++){
+        if (vec & 1)
+            sum ^= *mat;
+    }
+    return sum;
+}
+
+static void gf2MatrixSquare(uint32_t* square, const uint32_t* mat){
+    for (int n = 0; n < 32; n++)
+        square[n] = gf2MatrixTimes(mat, mat[n]);
+}
+
+//crc32c of a region followed by another one of len2 bytes, from crcs of both (zlib crc32_combine)
+static uint32_t crc32cCombine(uint32_t crc1, uint32_t crc2, size_t len2){
+    if (len2 == 0)
+        return crc1;
+
+    //odd: operator for one zero bit, then squared into operators for 2, 4, 8... zero bits
+    uint32_t even[32];
+    uint32_t odd [32];
+    odd[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++)
+        odd[n] = 1u << (n - 1);
+    gf2MatrixSquare(even, odd);
+    gf2MatrixSquare(odd, even);
+
+    //applies len2 zero bytes to crc1
+    do{
+        gf2MatrixSquare(even, odd);
+        if (len2 & 1)
+            crc1 = gf2MatrixTimes(even, crc1);
+        len2 >>= 1;
+        if (len2 == 0)
+            break;
+        gf2MatrixSquare(odd, even);
+        if (len2 & 1)
+            crc1 = gf2MatrixTimes(odd, crc1);
+        len2 >>= 1;
+    } while (len2 != 0);
+
+    return crc1 ^ crc2;
+}
+
+hash_t crc32cHash(const void* begin_ptr, const void* end_ptr){
+    return HASH_DEFAULT ^ (hash_t)crc32c(begin_ptr, end_ptr);
+}
+
+//fastest kernel this cpu has
+static hashKernel_t hashKernelDetect(){
+    return cpuHasSse42()? HASH_KERNEL_CRC32C : HASH_KERNEL_GNU_WORD;
+}
+
+//read by hash pool workers and verifier threads. Constant initialised, auto is resolved on first use
+static std::atomic<hashKernel_t> hash_kernel(HASH_KERNEL_AUTO);
+
+bool setHashKernel(hashKernel_t kernel){
+    switch (kernel){
+    case HASH_KERNEL_AUTO:
+        hash_kernel.store(hashKernelDetect(), std::memory_order_relaxed);
+        return true;
+    case HASH_KERNEL_GNU_REF:
+    case HASH_KERNEL_GNU_WORD:
+    case HASH_KERNEL_CRC32C:
+        hash_kernel.store(kernel, std::memory_order_relaxed);
+        return true;
+    default:
+        return false;
+    }
+}
+
+hashKernel_t getHashKernel(){
+    hashKernel_t kernel = hash_kernel.load(std::memory_order_relaxed);
+    if (kernel == HASH_KERNEL_AUTO){
+        hashKernel_t detected = hashKernelDetect();
+        //a kernel set meanwhile wins
+        if (!hash_kernel.compare_exchange_strong(kernel, detected, std::memory_order_relaxed))
+            return kernel;
+        kernel = detected;
+    }
+    return kernel;
+}
+
+bool hashKernelIsPolynomial(hashKernel_t kernel){
+    return kernel == HASH_KERNEL_GNU_REF || kernel == HASH_KERNEL_GNU_WORD;
+}
+
+hash_t dataHash(const void* begin_ptr, const void* end_ptr){
+    switch (getHashKernel()){
+    case HASH_KERNEL_GNU_REF:
+        return gnuHash(begin_ptr, end_ptr);
+    case HASH_KERNEL_CRC32C:
+        return crc32cHash(begin_ptr, end_ptr);
+    case HASH_KERNEL_GNU_WORD:
+    default:
+        return gnuHashFast(begin_ptr, end_ptr);
+    }
+}
+
+hash_t dataHashAppend(hash_t hash, const void* begin_ptr, const void* end_ptr){
+    switch (getHashKernel()){
+    case HASH_KERNEL_GNU_REF:
+        return gnuHashAppend(hash, begin_ptr, end_ptr);
+    case HASH_KERNEL_CRC32C:
+        return HASH_DEFAULT ^ (hash_t)crc32cAppend((uint32_t)(hash ^ HASH_DEFAULT), begin_ptr, end_ptr);
+    case HASH_KERNEL_GNU_WORD:
+    default:
+        return gnuHashAppendFast(hash, begin_ptr, end_ptr);
+    }
+}
+
+//workers are created on first use and live until exit
+struct HashThreadPool{
+    std::mutex                        mutex;
+    std::condition_variable           has_task;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread>          workers;
+    bool                              stop = false;
+
+    void grow(unsigned int count){
+        std::lock_guard<std::mutex> lock(mutex);
+        while (workers.size() < count)
+            workers.emplace_back([this]{ work(); });
+    }
+
+    void work(){
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true){
+            has_task.wait(lock, [this]{ return stop || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    void push(std::function<void()> task){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        has_task.notify_one();
+    }
+
+    ~HashThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        has_task.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+};
+
+static HashThreadPool hash_pool;
+
+static const size_t HASH_PARALLEL_MIN_CHUNK = 1 << 20;
+
+//threads worth using for len bytes, threads == 0 means all hardware threads
+static unsigned int hashParallelThreads(size_t len, unsigned int threads){
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (len / HASH_PARALLEL_MIN_CHUNK < threads)
+        threads = len / HASH_PARALLEL_MIN_CHUNK;
+    return threads;
+}
+
+//splits [begin, end) into `threads` chunks and calls hash_chunk(i, chunk_begin, chunk_end) for each,
+//chunk 0 on the calling thread. Chunks are len / threads bytes, the last one takes the rest
+template<typename func_t>
+static void hashRunChunks(const uint8_t* begin, const uint8_t* end, unsigned int threads, func_t hash_chunk){
+    size_t chunk_len = (end - begin) / threads;
+
+    std::mutex              done_mutex;
+    std::condition_variable all_done;
+    unsigned int            done = 0;
+
+    hash_pool.grow(threads - 1);
+    for (unsigned int i = 1; i < threads; i++){
+        const uint8_t* chunk_begin = begin + i * chunk_len;
+        const uint8_t* chunk_end   = (i == threads - 1) ? end : chunk_begin + chunk_len;
+        hash_pool.push([&, i, chunk_begin, chunk_end]{
+            hash_chunk(i, chunk_begin, chunk_end);
+            std::lock_guard<std::mutex> lock(done_mutex);
+            done++;
+            all_done.notify_one();
+        });
+    }
+    hash_chunk(0, begin, begin + chunk_len);
+
+    std::unique_lock<std::mutex> lock(done_mutex);
+    all_done.wait(lock, [&]{ return done == threads - 1; });
+}
+
+hash_t gnuHashParallel(const void* begin_ptr, const void* end_ptr, unsigned int threads){
+    const uint8_t* begin = (const uint8_t*)begin_ptr;
+    const uint8_t* end   = (const uint8_t*)end_ptr;
+    size_t len = (begin < end) ? end - begin : 0;
+
+    threads = hashParallelThreads(len, threads);
+    if (threads <= 1)
+        return gnuHashFast(begin_ptr, end_ptr);
+
+    //chunk hashes start from 0, so H = HASH_DEFAULT*33^len + sum(chunk_hash[i] * 33^(bytes after chunk i))
+    size_t chunk_len = len / threads;
+    std::vector<hash_t> chunk_hash(threads);
+    hashRunChunks(begin, end, threads, [&](unsigned int i, const uint8_t* chunk_begin, const uint8_t* chunk_end){
+        chunk_hash[i] = gnuHashAppendFast((i == 0)? HASH_DEFAULT : 0, chunk_begin, chunk_end);
+    });
+
+    hash_t hash = chunk_hash[0];
+    for (unsigned int i = 1; i < threads; i++){
+        size_t cur_len = (i == threads - 1) ? len - i * chunk_len : chunk_len;
+        hash = hash * gnuHashPow(cur_len) + chunk_hash[i];
+    }
+    return hash;
+}
+
+//same value as crc32cHash, chunk crcs are joined with crc32cCombine
+static hash_t crc32cHashParallel(const void* begin_ptr, const void* end_ptr, unsigned int threads){
+    const uint8_t* begin = (const uint8_t*)begin_ptr;
+    const uint8_t* end   = (const uint8_t*)end_ptr;
+    size_t len = (begin < end) ? end - begin : 0;
+
+    threads = hashParallelThreads(len, threads);
+    if (threads <= 1)
+        return crc32cHash(begin_ptr, end_ptr);
+
+    size_t chunk_len = len / threads;
+    std::vector<uint32_t> chunk_crc(threads);
+    hashRunChunks(begin, end, threads, [&](unsigned int i, const uint8_t* chunk_begin, const uint8_t* chunk_end){
+        chunk_crc[i] = crc32c(chunk_begin, chunk_end);
+    });
+
+    uint32_t crc = chunk_crc[0];
+    for (unsigned int i = 1; i < threads; i++){
+        size_t cur_len = (i == threads - 1) ? len - i * chunk_len : chunk_len;
+        crc = crc32cCombine(crc, chunk_crc[i], cur_len);
+    }
+    return HASH_DEFAULT ^ (hash_t)crc;
+}
+
+hash_t dataHashParallel(const void* begin_ptr, const void* end_ptr, unsigned int threads){
+    if (getHashKernel() == HASH_KERNEL_CRC32C)
+        return crc32cHashParallel(begin_ptr, end_ptr, threads);
+    return gnuHashParallel(begin_ptr, end_ptr, threads);
+}
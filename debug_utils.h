@@ -2,6 +2,7 @@
 #define DEBUG_UTILS_H_INCLUDED
 
 #include <stdint.h>
+#include <stddef.h>
 
 enum variableStatus_t{
     VARSTATUS_NEW    = 0,
@@ -32,8 +33,14 @@ typedef uint64_t canary_t;
 const canary_t CANARY_L = 0xDEADBEEFDEADBEEF;
 const canary_t CANARY_R = 0xFACEFEEDFACEFEED;
 
-bool checkLCanary(const void* ptr);
-bool checkRCanary(const void* ptr, size_t len);
+//left canary precedes data, unaligned in blocks aligned by their end (guard pages)
+bool     checkLCanary(const void* ptr);
+void     setLCanary  (void* ptr);
+canary_t getLCanary  (const void* ptr);
+//right canary follows len bytes of data, so it may be unaligned
+bool     checkRCanary(const void* ptr, size_t len);
+void     setRCanary  (void* ptr, size_t len);
+canary_t getRCanary  (const void* ptr, size_t len);
 
 
 //hash function
@@ -42,4 +49,40 @@ const hash_t HASH_DEFAULT = 0xDEFEC8EDBAADBEEF;
 
 hash_t gnuHash(const void* begin_ptr, const void* end_ptr);
 
+//continues gnuHash: gnuHash(a, c) == gnuHashAppend(gnuHash(a, b), b, c)
+hash_t gnuHashAppend(hash_t hash, const void* begin_ptr, const void* end_ptr);
+
+//33^len and its inverse (mod 2^64), used to remove bytes from the end of a hash
+hash_t gnuHashPow   (size_t len);
+hash_t gnuHashPowInv(size_t len);
+
+//same values as gnuHash/gnuHashAppend, processes several bytes per iteration
+hash_t gnuHashFast      (const void* begin_ptr, const void* end_ptr);
+hash_t gnuHashAppendFast(hash_t hash, const void* begin_ptr, const void* end_ptr);
+
+//crc32c (uses SSE4.2 if cpu supports it) mixed with HASH_DEFAULT. Not compatible with gnuHash
+hash_t crc32cHash(const void* begin_ptr, const void* end_ptr);
+
+enum hashKernel_t{
+    HASH_KERNEL_GNU_REF  = 0, //gnuHash, one byte per iteration
+    HASH_KERNEL_GNU_WORD = 1, //gnuHashFast
+    HASH_KERNEL_CRC32C   = 2,
+    HASH_KERNEL_AUTO     = 3  //chosen by cpu: CRC32C with SSE4.2, GNU_WORD otherwise. Default
+};
+
+//kernel used by dataHash. Must be chosen before any hash is stored, returns false if kernel is not available
+bool setHashKernel(hashKernel_t kernel);
+//kernel dataHash uses, auto is already resolved
+hashKernel_t getHashKernel();
+bool hashKernelIsPolynomial(hashKernel_t kernel);
+
+hash_t dataHash(const void* begin_ptr, const void* end_ptr);
+//continues dataHash: dataHash(a, c) == dataHashAppend(dataHash(a, b), b, c), dataHash of nothing is HASH_DEFAULT
+hash_t dataHashAppend(hash_t hash, const void* begin_ptr, const void* end_ptr);
+
+//same value as gnuHash / dataHash, region is split into chunks hashed on a thread pool
+//threads == 0 means all hardware threads
+hash_t gnuHashParallel (const void* begin_ptr, const void* end_ptr, unsigned int threads);
+hash_t dataHashParallel(const void* begin_ptr, const void* end_ptr, unsigned int threads);
+
 #endif // DEBUG_UTILS_H_INCLUDED
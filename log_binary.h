@@ -0,0 +1,133 @@
+#ifndef LOG_BINARY_H_INCLUDED
+#define LOG_BINARY_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+//Binary log: magic, then records. Native byte order, decoded on the same kind of machine (logdecode).
+//Format strings are written once per run as LOG_BIN_FORMAT records, messages refer to them by id
+//and carry only a timestamp and raw arguments. Format records may come after messages that use them.
+//
+//LOG_BIN_FORMAT : u8 kind, u32 id, u8 timestamp, u16 tag_len, u32 format_len, tag, format
+//LOG_BIN_MESSAGE: u8 kind, u32 id, i64 time (ns since epoch), u32 args_size, args (u8 logBinArg_t + value each)
+//LOG_BIN_ELEMS  : u8 kind, u32 id (element format, "" for hex), u32 elem_size, u64 size (slots below are
+//                 in use), u64 first, u64 count, u8 compress_poison, poison value, count elements from first
+
+static const char   LOG_BIN_MAGIC[8]    = {'S', 'T', 'K', 'L', 'O', 'G', '0', '2'};
+static const size_t LOG_BIN_MAGIC_LEN   = sizeof(LOG_BIN_MAGIC);
+//older version, message time is in seconds
+static const char   LOG_BIN_MAGIC_V1[8] = {'S', 'T', 'K', 'L', 'O', 'G', '0', '1'};
+
+enum logBinRecord_t{
+    LOG_BIN_FORMAT  = 1,
+    LOG_BIN_MESSAGE = 2,
+    LOG_BIN_ELEMS   = 3
+};
+
+enum logBinArg_t{
+    LOG_ARG_INT    = 1, //i64
+    LOG_ARG_UINT   = 2, //u64
+    LOG_ARG_DOUBLE = 3, //double
+    LOG_ARG_STR    = 4, //u32 length, chars
+    LOG_ARG_PTR    = 5  //u64
+};
+
+//record being built, in thread's staging buffer or heap memory when it does not fit
+struct LogPacker{
+    char*  buf;
+    size_t size;
+    size_t capacity;
+    bool   heap;
+    bool   failed; //out of memory, record is dropped
+};
+
+bool logPackReserve(LogPacker* packer, size_t add);
+
+inline void logPackBytes(LogPacker* packer, const void* src, size_t len){
+    if (!logPackReserve(packer, len))
+        return;
+    memcpy(packer->buf + packer->size, src, len);
+    packer->size += len;
+}
+
+template<typename value_t>
+inline void logPackValue(LogPacker* packer, value_t value){
+    logPackBytes(packer, &value, sizeof(value));
+}
+
+inline void logPackStr(LogPacker* packer, const char* str){
+    if (str == nullptr)
+        str = "(null)";
+    uint32_t len = (uint32_t)strlen(str);
+    logPackValue(packer, (uint8_t)LOG_ARG_STR);
+    logPackValue(packer, len);
+    logPackBytes(packer, str, len);
+}
+
+//char pointers are copied as strings only for %s, a char buffer passed to %p may have no terminator
+template<typename arg_t>
+inline void logPackArg(LogPacker* packer, const arg_t& arg, bool is_str){
+    typedef std::decay_t<arg_t> type;
+    if constexpr (std::is_same_v<type, const char*> || std::is_same_v<type, char*>){
+        if (is_str){
+            logPackStr(packer, arg);
+        }
+        else{
+            logPackValue(packer, (uint8_t)LOG_ARG_PTR);
+            logPackValue(packer, (uint64_t)(uintptr_t)(const void*)arg);
+        }
+    }
+    else if constexpr (std::is_pointer_v<type> || std::is_null_pointer_v<type>){
+        logPackValue(packer, (uint8_t)LOG_ARG_PTR);
+        logPackValue(packer, (uint64_t)(uintptr_t)(const void*)arg);
+    }
+    else if constexpr (std::is_floating_point_v<type>){
+        logPackValue(packer, (uint8_t)LOG_ARG_DOUBLE);
+        logPackValue(packer, (double)arg);
+    }
+    else if constexpr (std::is_enum_v<type> || (std::is_integral_v<type> && std::is_signed_v<type>)){
+        logPackValue(packer, (uint8_t)LOG_ARG_INT);
+        logPackValue(packer, (int64_t)arg);
+    }
+    else if constexpr (std::is_integral_v<type>){
+        logPackValue(packer, (uint8_t)LOG_ARG_UINT);
+        logPackValue(packer, (uint64_t)arg);
+    }
+    else{
+        static_assert(sizeof(type) == 0, "argument type can not be written to binary log");
+    }
+}
+
+//location (file, line, func) is baked into the format, nullptr file for none
+uint32_t logFormatId_(bool timestamp, const char* tag, const char* format,
+                      const char* file, int line, const char* func);
+
+//bit i is set if argument i is taken by %s (arguments past 64 are all treated as strings)
+uint64_t logStrArgs_(const char* format);
+
+//registered once per call site
+struct LogCallSite{
+    uint32_t id;
+    uint64_t str_args;
+};
+
+void logBinaryBegin_(LogPacker* packer, uint32_t id);
+
+void logBinaryEnd_  (LogPacker* packer);
+
+template<typename... args_t>
+void logBinary_(const LogCallSite* site, const char* /*format*/, const args_t&... args){
+    LogPacker packer = {};
+    logBinaryBegin_(&packer, site->id);
+    size_t index = 0;
+    (logPackArg(&packer, args, index >= 64 || ((site->str_args >> index++) & 1)), ...);
+    logBinaryEnd_(&packer);
+}
+
+//slots [first, first + count) of an element array
+void logBinaryElems_(uint32_t id, const void* data, size_t elem_size, size_t size, size_t first, size_t count,
+                     const void* poison, bool compress_poison);
+
+#endif // LOG_BINARY_H_INCLUDED
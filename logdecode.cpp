@@ -0,0 +1,434 @@
+//Renders binary log (logStartBinary) as text, same as the text log would be.
+//Usage: logdecode [binary log, log.bin by default] > log.txt
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "log_binary.h"
+
+//format ids are call sites of a program, a larger one is a broken record
+static const uint32_t LOG_DECODE_MAX_FORMATS = 1 << 20;
+
+struct DecodeFormat{
+    bool        defined;
+    bool        timestamp;
+    std::string tag;
+    std::string format;
+};
+
+struct DecodeArg{
+    uint8_t     type;
+    int64_t     i;
+    uint64_t    u;
+    double      d;
+    std::string str;
+};
+
+struct DecodeReader{
+    const char* pos;
+    const char* end;
+    bool        bad;
+};
+
+static void readBytes(DecodeReader* reader, void* dest, size_t len){
+    if (reader->bad || (size_t)(reader->end - reader->pos) < len){
+        reader->bad = true;
+        memset(dest, 0, len);
+        return;
+    }
+    memcpy(dest, reader->pos, len);
+    reader->pos += len;
+}
+
+template<typename value_t>
+static value_t readValue(DecodeReader* reader){
+    value_t value = {};
+    readBytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static const char* readSkip(DecodeReader* reader, size_t len){
+    const char* begin = reader->pos;
+    if (reader->bad || (size_t)(reader->end - reader->pos) < len){
+        reader->bad = true;
+        return nullptr;
+    }
+    reader->pos += len;
+    return begin;
+}
+
+//count elements of elem_size bytes, sizes come from the file and are checked before multiplying
+static const char* readSkipElems(DecodeReader* reader, uint32_t elem_size, uint64_t count){
+    if (reader->bad || elem_size == 0 || count > (uint64_t)(reader->end - reader->pos) / elem_size){
+        reader->bad = true;
+        return nullptr;
+    }
+    return readSkip(reader, (size_t)(elem_size * count));
+}
+
+static bool readArg(DecodeReader* reader, DecodeArg* arg){
+    arg->type = readValue<uint8_t>(reader);
+    switch (arg->type){
+    case LOG_ARG_INT:
+        arg->i = readValue<int64_t>(reader);
+        arg->u = (uint64_t)arg->i;
+        arg->d = (double)arg->i;
+        break;
+    case LOG_ARG_UINT:
+    case LOG_ARG_PTR:
+        arg->u = readValue<uint64_t>(reader);
+        arg->i = (int64_t)arg->u;
+        arg->d = (double)arg->u;
+        break;
+    case LOG_ARG_DOUBLE:
+        arg->d = readValue<double>(reader);
+        arg->i = (int64_t)arg->d;
+        arg->u = (uint64_t)arg->i;
+        break;
+    case LOG_ARG_STR:{
+        uint32_t    len = readValue<uint32_t>(reader);
+        const char* str = readSkip(reader, len);
+        if (str != nullptr)
+            arg->str.assign(str, len);
+        break;
+    }
+    default:
+        reader->bad = true;
+    }
+    return !reader->bad;
+}
+
+//one conversion with the argument converted to what the conversion expects
+static void printConversion(FILE* out, std::string spec, char conv, const DecodeArg* arg){
+    if (arg == nullptr){
+        fprintf(out, "<missing>");
+        return;
+    }
+    switch (conv){
+    case 'd': case 'i':
+        spec += "ll";
+        spec += conv;
+        fprintf(out, spec.c_str(), (long long)arg->i);
+        break;
+    case 'u': case 'o': case 'x': case 'X':
+        spec += "ll";
+        spec += conv;
+        fprintf(out, spec.c_str(), (unsigned long long)arg->u);
+        break;
+    case 'c':
+        spec += conv;
+        fprintf(out, spec.c_str(), (int)arg->i);
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        spec += conv;
+        fprintf(out, spec.c_str(), arg->d);
+        break;
+    case 's':
+        spec += conv;
+        fprintf(out, spec.c_str(), (arg->type == LOG_ARG_STR)? arg->str.c_str() : "<not a string>");
+        break;
+    case 'p':
+        spec += conv;
+        fprintf(out, spec.c_str(), (void*)(uintptr_t)arg->u);
+        break;
+    default:
+        break;
+    }
+}
+
+static void printFormatted(FILE* out, const char* format, const std::vector<DecodeArg>& args){
+    size_t next_arg = 0;
+    auto takeArg = [&]() -> const DecodeArg* {
+        return (next_arg < args.size())? &args[next_arg++] : nullptr;
+    };
+
+    for (const char* ch = format; *ch != '\0'; ch++){
+        if (*ch != '%'){
+            fputc(*ch, out);
+            continue;
+        }
+        ch++;
+        if (*ch == '%'){
+            fputc('%', out);
+            continue;
+        }
+
+        std::string spec = "%";
+        while (*ch != '\0' && strchr("-+ #0", *ch) != nullptr)
+            spec += *ch++;
+        if (*ch == '*'){
+            const DecodeArg* width = takeArg();
+            spec += std::to_string((width != nullptr)? width->i : 0);
+            ch++;
+        }
+        while (*ch >= '0' && *ch <= '9')
+            spec += *ch++;
+        if (*ch == '.'){
+            spec += *ch++;
+            if (*ch == '*'){
+                const DecodeArg* precision = takeArg();
+                spec += std::to_string((precision != nullptr)? precision->i : 0);
+                ch++;
+            }
+            while (*ch >= '0' && *ch <= '9')
+                spec += *ch++;
+        }
+        //length is replaced by the one matching the stored argument
+        while (*ch != '\0' && strchr("hlLqjztI", *ch) != nullptr)
+            ch++;
+        while (*ch >= '0' && *ch <= '9') //I32, I64
+            ch++;
+        if (*ch == '\0')
+            break;
+        if (*ch == 'n')
+            continue;
+        printConversion(out, spec, *ch, takeArg());
+    }
+}
+
+//time_ns: time_value is in nanoseconds (current format), else in seconds (STKLOG01)
+static void printTime(FILE* out, int64_t time_value, bool time_ns){
+    const int64_t ns_per_sec = 1000000000;
+    time_t time = (time_t)(time_ns? time_value / ns_per_sec : time_value);
+    tm* tm_time = localtime(&time);
+    if (tm_time == nullptr)
+        return;
+    if (time_ns)
+        fprintf(out, "[%02d:%02d:%02d.%06d]", tm_time->tm_hour, tm_time->tm_min, tm_time->tm_sec,
+                (int)((time_value % ns_per_sec) / 1000));
+    else
+        fprintf(out, "[%02d:%02d:%02d]", tm_time->tm_hour, tm_time->tm_min, tm_time->tm_sec);
+}
+
+static const DecodeFormat* findFormat(const std::vector<DecodeFormat>& formats, uint32_t id){
+    if (id >= formats.size() || !formats[id].defined)
+        return nullptr;
+    return &formats[id];
+}
+
+static void printElem(FILE* out, const DecodeFormat* format, const char* elem, uint32_t elem_size){
+    const char* spec = (format != nullptr)? format->format.c_str() : "";
+    const char* conv = strchr(spec, '%');
+    if (conv == nullptr || elem_size > sizeof(uint64_t) * 2){
+        for (uint32_t i = 0; i < elem_size; i++)
+            fprintf(out, "%02x", (uint8_t)elem[i]);
+        return;
+    }
+    while (*conv != '\0' && strchr("diuoxXcfFeEgGaAps", *conv) == nullptr)
+        conv++;
+
+    DecodeArg arg = {};
+    if (strchr("fFeEgGaA", *conv) != nullptr && *conv != '\0'){
+        arg.type = LOG_ARG_DOUBLE;
+        if (elem_size == sizeof(float)){
+            float value = 0;
+            memcpy(&value, elem, sizeof(value));
+            arg.d = value;
+        }
+        else if (elem_size == sizeof(double)){
+            memcpy(&arg.d, elem, sizeof(arg.d));
+        }
+        else{
+            long double value = 0;
+            memcpy(&value, elem, (elem_size < sizeof(value))? elem_size : sizeof(value));
+            arg.d = (double)value;
+        }
+    }
+    else{
+        //sign extended for signed conversions
+        uint64_t value = 0;
+        memcpy(&value, elem, (elem_size < sizeof(value))? elem_size : sizeof(value));
+        arg.type = LOG_ARG_UINT;
+        arg.u    = value;
+        arg.i    = (int64_t)value;
+        if (elem_size < sizeof(value) && strchr("dic", *conv) != nullptr && *conv != '\0'){
+            int shift = 64 - 8 * elem_size;
+            arg.i = (int64_t)(value << shift) >> shift;
+        }
+    }
+    printFormatted(out, spec, std::vector<DecodeArg>{arg});
+}
+
+//same rows as stackDump prints in text mode
+static void printElems(FILE* out, DecodeReader* reader, const std::vector<DecodeFormat>& formats){
+    uint32_t id        = readValue<uint32_t>(reader);
+    uint32_t elem_size = readValue<uint32_t>(reader);
+    uint64_t size      = readValue<uint64_t>(reader);
+    uint64_t first     = readValue<uint64_t>(reader);
+    uint64_t count     = readValue<uint64_t>(reader);
+    bool     compress  = readValue<uint8_t >(reader) != 0;
+    const char* poison = readSkipElems(reader, elem_size, 1);
+    const char* data   = readSkipElems(reader, elem_size, count);
+    if (first + count < first)
+        reader->bad = true;
+    if (reader->bad)
+        return;
+
+    const DecodeFormat* format = findFormat(formats, id);
+    auto isPoison = [&](uint64_t i){
+        return memcmp(data + (i - first) * elem_size, poison, elem_size) == 0;
+    };
+
+    for (uint64_t i = first; i < first + count; i++){
+        if (compress && isPoison(i)){
+            uint64_t run_end = i + 1;
+            while (run_end < first + count && (run_end < size) == (i < size) && isPoison(run_end))
+                run_end++;
+            if (run_end - i >= 2){
+                fprintf(out, "    %c[%llu..%llu] POISON x %llu\n", (i < size)? '*' : ' ',
+                        (unsigned long long)i, (unsigned long long)(run_end - 1), (unsigned long long)(run_end - i));
+                i = run_end - 1;
+                continue;
+            }
+        }
+        fprintf(out, "    %c[%llu] ", (i < size)? '*' : ' ', (unsigned long long)i);
+        printElem(out, format, data + (i - first) * elem_size, elem_size);
+        fprintf(out, "%s", isPoison(i)? " (POISON)\n" : " \n");
+    }
+}
+
+static void printMessage(FILE* out, DecodeReader* reader, const std::vector<DecodeFormat>& formats, bool time_ns){
+    uint32_t id        = readValue<uint32_t>(reader);
+    int64_t  time      = readValue<int64_t >(reader);
+    uint32_t args_size = readValue<uint32_t>(reader);
+    const char* args_begin = readSkip(reader, args_size);
+    if (reader->bad)
+        return;
+
+    std::vector<DecodeArg> args;
+    DecodeReader args_reader = {args_begin, args_begin + args_size, false};
+    while (args_reader.pos < args_reader.end){
+        DecodeArg arg = {};
+        if (!readArg(&args_reader, &arg))
+            break;
+        args.push_back(arg);
+    }
+
+    const DecodeFormat* format = findFormat(formats, id);
+    if (format == nullptr){
+        fprintf(out, "<unknown format %u, %zu args>\n", id, args.size());
+        return;
+    }
+    if (format->timestamp)
+        printTime(out, time, time_ns);
+    fputs(format->tag.c_str(), out);
+    printFormatted(out, format->format.c_str(), args);
+}
+
+static void readFormat(DecodeReader* reader, std::vector<DecodeFormat>* formats){
+    uint32_t id         = readValue<uint32_t>(reader);
+    uint8_t  timestamp  = readValue<uint8_t >(reader);
+    uint16_t tag_len    = readValue<uint16_t>(reader);
+    uint32_t format_len = readValue<uint32_t>(reader);
+    const char* tag     = readSkip(reader, tag_len);
+    const char* format  = readSkip(reader, format_len);
+    if (id >= LOG_DECODE_MAX_FORMATS)
+        reader->bad = true;
+    if (reader->bad)
+        return;
+
+    if (id >= formats->size())
+        formats->resize(id + 1);
+    (*formats)[id] = {true, timestamp != 0, std::string(tag, tag_len), std::string(format, format_len)};
+}
+
+//format version of the run starting at pos, 0 if there is no magic
+static int magicVersion(const char* pos, const char* end){
+    if ((size_t)(end - pos) < LOG_BIN_MAGIC_LEN)
+        return 0;
+    if (memcmp(pos, LOG_BIN_MAGIC, LOG_BIN_MAGIC_LEN) == 0)
+        return 2;
+    if (memcmp(pos, LOG_BIN_MAGIC_V1, LOG_BIN_MAGIC_LEN) == 0)
+        return 1;
+    return 0;
+}
+
+static bool isMagic(const DecodeReader* reader){
+    return magicVersion(reader->pos, reader->end) != 0;
+}
+
+//records of one run: formats may come after messages using them, so formats are read first
+static const char* decodeRun(FILE* out, const char* begin, const char* end, int version){
+    std::vector<DecodeFormat> formats;
+
+    for (int pass = 0; pass < 2; pass++){
+        DecodeReader reader = {begin, end, false};
+        while (reader.pos < reader.end && !isMagic(&reader)){
+            uint8_t kind = readValue<uint8_t>(&reader);
+            switch (kind){
+            case LOG_BIN_FORMAT:
+                readFormat(&reader, &formats);
+                break;
+            case LOG_BIN_MESSAGE:
+                if (pass == 0){
+                    readSkip(&reader, sizeof(uint32_t) + sizeof(int64_t));
+                    readSkip(&reader, readValue<uint32_t>(&reader));
+                }
+                else{
+                    printMessage(out, &reader, formats, version >= 2);
+                }
+                break;
+            case LOG_BIN_ELEMS:
+                if (pass == 0){
+                    readSkip(&reader, sizeof(uint32_t));
+                    uint32_t elem_size = readValue<uint32_t>(&reader);
+                    readSkip(&reader, 2 * sizeof(uint64_t));
+                    uint64_t count     = readValue<uint64_t>(&reader);
+                    readSkip(&reader, sizeof(uint8_t));
+                    readSkipElems(&reader, elem_size, 1);
+                    readSkipElems(&reader, elem_size, count);
+                }
+                else{
+                    printElems(out, &reader, formats);
+                }
+                break;
+            default:
+                reader.bad = true;
+            }
+            if (reader.bad){
+                if (pass == 1)
+                    fprintf(stderr, "logdecode: broken record at offset %zu, rest of the run skipped\n",
+                            (size_t)(reader.pos - begin));
+                break;
+            }
+        }
+        if (pass == 1)
+            return reader.bad? end : reader.pos;
+    }
+    return end;
+}
+
+int main(int argc, const char* argv[]){
+    const char* path = (argc > 1)? argv[1] : "log.bin";
+
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr){
+        perror("logdecode: can not open binary log");
+        return EXIT_FAILURE;
+    }
+    std::vector<char> data;
+    char chunk[1 << 16];
+    size_t read = 0;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + read);
+    fclose(file);
+
+    const char* pos = data.data();
+    const char* end = data.data() + data.size();
+    while (pos < end){
+        int version = magicVersion(pos, end);
+        if (version == 0){
+            fprintf(stderr, "logdecode: %s is not a binary log\n", path);
+            return EXIT_FAILURE;
+        }
+        pos += LOG_BIN_MAGIC_LEN;
+        printf("------------------------------------\n");
+        pos = decodeRun(stdout, pos, end, version);
+    }
+    return 0;
+}
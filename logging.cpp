@@ -4,19 +4,46 @@
 #include <errno.h>
 #include <string.h>
 #include <stdarg.h>
-#include <windows.h>
+#include <stdint.h>
+#include <signal.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
 
-#include "time_utils.h"
-#include "Console_utils.h"
-#include "debug_utils.h"
+#ifndef _WIN32
+    #include <unistd.h>
+    #include <sys/uio.h>
+#endif
 
-static const int max_print_args = 100;
+#include "logging.h"
+#include "ptr_utils.h"
 
 FILE* initLogFile();
 
 FILE* _logfile = initLogFile();
 
+logLevel_t _log_level = LOG_LEVEL_DEBUG;
+
+std::atomic<bool> _log_binary {false};
+static FILE*      log_binfile = nullptr;
+//held while the sync path writes log_binfile and while it is opened or closed
+static std::mutex log_binfile_mutex;
+
+//filenos of _logfile, stderr and log_binfile, so signal handlers do not call stdio
+static int              log_fd        = -1;
+static const int        LOG_STDERR_FD = 2; //STDERR_FILENO, not defined on Windows
+static std::atomic<int> log_binfd     {-1};
+
+void setLogLevel(logLevel_t level){
+    _log_level = level;
+}
+
 void printGoodbyeMsg(){
+    logStopAsync();
+    logStopBinary();
     fprintf(_logfile, "Program exited\n");
 }
 
@@ -26,10 +53,13 @@ FILE* initLogFile(){
         perror("Error opening log file");
     }
 
+    //unbuffered: in sync mode everything logged before a crash is in the file
     if (setvbuf(logfile, nullptr, _IONBF, 0) != 0){
         perror("Warning: can not set log file buffer");
     }
 
+    log_fd = fileno(logfile);
+
     fprintf(logfile, "------------------------------------\n");
     fprint_time_date_short(logfile, time(nullptr));
     fprintf(logfile, "Program started\n");
@@ -38,89 +68,778 @@ FILE* initLogFile(){
     return logfile;
 }
 
-void printVarInfo_log(const VarInfo *var){
-    setConsoleColor(stderr, COLOR_WHITE, COLOR_BLACK);
 
-    if(var != nullptr){
-    fprintf(_logfile, "     Variable info:     Name: %s\n"
-                      "                      Status: %s\n"
-                      "                  Created at: %s :%d\n"
-                      "                 In function: %s\n",
-    strPrintable(var->name), varstatusAsString(var->status) , strPrintable(var->file), var->line, strPrintable(var->func));
-
-    fprintf( stderr , "     Variable info:     Name: %s\n"
-                      "                      Status: %s\n"
-                      "                  Created at: %s :%d\n"
-                      "                 In function: %s\n",
-    strPrintable(var->name), varstatusAsString(var->status) , strPrintable(var->file), var->line, strPrintable(var->func));
+//Async backend: one SPSC ring per producer thread, rings are never freed and are reused
+//by new threads after the owner exits. Record = LogRecord header + text, 8-byte aligned
+static const size_t LOG_RING_SIZE     = 1 << 16;
+static const size_t LOG_MAX_RECORD    = 4096; //longer messages are formatted into heap memory
+static const int    LOG_IOV_MAX       = 64;
+static const int    LOG_POLL_MS       = 2;
+static const int    LOG_CRASH_SPINS   = 1 << 26; //crash handler spins this long for the writer, no yield
+static const uint8_t LOG_RECORD_PAD    = 0xFF; //filler up to the ring end
+static const uint8_t LOG_RECORD_BINARY = 0xFE; //goes to the binary log only
+
+struct LogRecord{
+    uint32_t size;        //with header and alignment
+    uint32_t len;
+    uint16_t prefix_len;  //timestamp, written to the file only
+    uint8_t  text_color;
+    uint8_t  back_color;
+};
+
+struct LogRing{
+    char*               data;
+    LogRing*            next;
+    std::atomic<bool>   owned;
+    alignas(64) std::atomic<size_t> head; //bytes written, producer
+    alignas(64) std::atomic<size_t> tail; //bytes consumed, writer
+};
+
+//exiting thread writes out its messages, so they come before anything logged after join
+struct LogRingOwner{
+    LogRing* ring = nullptr;
+    ~LogRingOwner();
+};
+
+static std::atomic<LogRing*> log_rings    {nullptr};
+static std::atomic<bool>     log_async    {false};
+static std::atomic<bool>     log_stop     {false};
+static std::atomic<bool>     log_draining {false};
+static thread_local bool     log_in_drain = false; //this thread holds log_draining
+static std::mutex            log_control_mutex;
+static std::thread*          log_writer = nullptr; //not a static object: joined from atexit, after static destructors
+
+static thread_local LogRingOwner log_ring_owner;
+
+static size_t logAlign(size_t size){
+    return (size + 7) & ~(size_t)7;
+}
+
+static LogRing* logThreadRing(){
+    if (log_ring_owner.ring != nullptr)
+        return log_ring_owner.ring;
+
+    for (LogRing* ring = log_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next){
+        bool owned = false;
+        if (ring->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)){
+            log_ring_owner.ring = ring;
+            return ring;
+        }
     }
-    else{
-        fprintf(_logfile, "     Variable info: info is nullptr\n");
-        fprintf( stderr , "     Variable info: info is nullptr\n");
+
+    LogRing* ring = new LogRing;
+    ring->data = (char*)malloc(LOG_RING_SIZE);
+    if (ring->data == nullptr){
+        delete ring;
+        return nullptr;
+    }
+    ring->owned.store(true, std::memory_order_relaxed);
+    ring->head .store(0   , std::memory_order_relaxed);
+    ring->tail .store(0   , std::memory_order_relaxed);
+    ring->next = log_rings.load(std::memory_order_relaxed);
+    while (!log_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release))
+        ;
+    log_ring_owner.ring = ring;
+    return ring;
+}
+
+//false if record does not fit or async mode was stopped while waiting for space
+static bool logRingPush(const char* msg, size_t len, size_t prefix_len, consoleColor text_color, consoleColor back_color){
+    size_t need = logAlign(sizeof(LogRecord) + len);
+    if (need > LOG_RING_SIZE / 2)
+        return false;
+    LogRing* ring = logThreadRing();
+    if (ring == nullptr)
+        return false;
+
+    size_t head       = ring->head.load(std::memory_order_relaxed);
+    size_t pos        = head & (LOG_RING_SIZE - 1);
+    size_t contiguous = LOG_RING_SIZE - pos;
+    size_t total      = need + ((contiguous < need)? contiguous : 0);
+
+    while (LOG_RING_SIZE - (head - ring->tail.load(std::memory_order_acquire)) < total){
+        if (!log_async.load(std::memory_order_relaxed))
+            return false;
+        std::this_thread::yield();
+    }
+
+    if (contiguous < need){
+        LogRecord* pad  = (LogRecord*)(ring->data + pos);
+        pad->size       = (uint32_t)contiguous;
+        pad->text_color = LOG_RECORD_PAD;
+        head += contiguous;
+        pos   = 0;
+    }
+
+    LogRecord* rec  = (LogRecord*)(ring->data + pos);
+    rec->size       = (uint32_t)need;
+    rec->len        = (uint32_t)len;
+    rec->prefix_len = (uint16_t)prefix_len;
+    rec->text_color = (uint8_t)text_color;
+    rec->back_color = (uint8_t)back_color;
+    memcpy(rec + 1, msg, len);
+
+    ring->head.store(head + need, std::memory_order_release);
+    return true;
+}
+
+//pieces of text written with one writev (one fwrite per piece on Windows)
+struct LogBatch{
+    FILE*  out;
+    int    fd;
+    int    count;
+    #ifndef _WIN32
+        iovec iov[LOG_IOV_MAX];
+    #endif
+};
+
+static void logBatchFlush(LogBatch* batch){
+    #ifndef _WIN32
+        iovec* iov   = batch->iov;
+        int    count = batch->count;
+        while (count > 0){
+            ssize_t written = writev(batch->fd, iov, count);
+            if (written < 0){
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            while (count > 0 && (size_t)written >= iov->iov_len){
+                written -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0){
+                iov->iov_base = (char*)iov->iov_base + written;
+                iov->iov_len -= written;
+            }
+        }
+    #endif
+    batch->count = 0;
+}
+
+static void logBatchInit(LogBatch* batch, FILE* out, int fd){
+    batch->out   = out;
+    batch->fd    = fd;
+    batch->count = 0;
+}
+
+static void logBatchAdd(LogBatch* batch, const char* text, size_t len){
+    if (len == 0)
+        return;
+    #ifndef _WIN32
+        if (batch->count == LOG_IOV_MAX)
+            logBatchFlush(batch);
+        batch->iov[batch->count].iov_base = (void*)text;
+        batch->iov[batch->count].iov_len  = len;
+        batch->count++;
+    #else
+        fwrite(text, 1, len, batch->out);
+    #endif
+}
+
+//writes out all records, tail is moved only after they are written
+static void logDrainRing(LogRing* ring, LogBatch* file, LogBatch* console, LogBatch* binary, int* color, bool crash){
+    size_t tail = ring->tail.load(std::memory_order_relaxed);
+    size_t head = ring->head.load(std::memory_order_acquire);
+
+    while (tail < head){
+        LogRecord* rec = (LogRecord*)(ring->data + (tail & (LOG_RING_SIZE - 1)));
+        tail += rec->size;
+        if (rec->text_color == LOG_RECORD_PAD)
+            continue;
+
+        const char* text = (const char*)(rec + 1);
+        size_t      len  = rec->len;
+
+        if (rec->text_color == LOG_RECORD_BINARY){
+            if (binary->fd != -1)
+                logBatchAdd(binary, text, len);
+            continue;
+        }
+
+        logBatchAdd(file, text, len);
+
+        int rec_color = (rec->text_color << 8) | rec->back_color;
+        if (!crash && rec_color != *color){
+            logBatchFlush(console);
+            setConsoleColor(stderr, (consoleColor)rec->text_color, (consoleColor)rec->back_color);
+            *color = rec_color;
+        }
+        logBatchAdd(console, text + rec->prefix_len, len - rec->prefix_len);
     }
 
+    logBatchFlush(file);
+    logBatchFlush(console);
+    logBatchFlush(binary);
+    ring->tail.store(tail, std::memory_order_release);
+}
+
+//caller holds log_draining. In crash mode only writev(2) is used
+static void logDrainRings(bool crash){
+    LogBatch file    = {};
+    LogBatch console = {};
+    LogBatch binary  = {};
+    logBatchInit(&file   , _logfile   , log_fd);
+    logBatchInit(&console, stderr     , LOG_STDERR_FD);
+    logBatchInit(&binary , log_binfile, log_binfd.load(std::memory_order_relaxed));
+
+    int color = -1;
+    for (LogRing* ring = log_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+        logDrainRing(ring, &file, &console, &binary, &color, crash);
+    if (color != -1)
+        setConsoleColor(stderr, COLOR_DEFAULTT, COLOR_BLACK);
+}
+
+static void logDrainAll(){
+    while (log_draining.exchange(true, std::memory_order_acquire))
+        std::this_thread::yield();
+    log_in_drain = true;
+    logDrainRings(false);
+    log_in_drain = false;
+    log_draining.store(false, std::memory_order_release);
+}
+
+//async-signal-safe: spins without yielding and never drains next to another drainer,
+//so rings are skipped if this thread crashed while draining them or the writer does not
+//finish in LOG_CRASH_SPINS
+static void logCrashDrain(){
+    if (log_in_drain){
+        logSignalWrite("[crash] log rings not written: crashed while writing them\n");
+        return;
+    }
+    for (int i = 0; log_draining.load(std::memory_order_relaxed) ||
+                    log_draining.exchange(true, std::memory_order_acquire); i++){
+        if (i >= LOG_CRASH_SPINS){
+            logSignalWrite("[crash] log rings not written: writer is busy\n");
+            return;
+        }
+    }
+    logDrainRings(true);
+    log_draining.store(false, std::memory_order_release);
+}
+
+LogRingOwner::~LogRingOwner(){
+    if (ring == nullptr)
+        return;
+    if (log_async.load(std::memory_order_acquire))
+        logDrainAll();
+    ring->owned.store(false, std::memory_order_release);
+}
+
+static void logWriterLoop(){
+    while (!log_stop.load(std::memory_order_acquire)){
+        logDrainAll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOG_POLL_MS));
+    }
+    logDrainAll();
+}
+
+static const int LOG_CRASH_SIGNALS[] = {SIGSEGV, SIGABRT, SIGFPE, SIGILL};
+static const int LOG_CRASH_SIGNALS_N = sizeof(LOG_CRASH_SIGNALS) / sizeof(LOG_CRASH_SIGNALS[0]);
+
+#ifndef _WIN32
+    static struct sigaction log_old_actions[LOG_CRASH_SIGNALS_N];
+#else
+    static void (*log_old_handlers[LOG_CRASH_SIGNALS_N])(int);
+#endif
+
+//later messages go straight to the file. The signal is raised again for the previous handler,
+//it is delivered when this one returns (a fault would repeat anyway, raise or kill would not)
+static void logCrashHandler(int sig){
+    log_async.store(false, std::memory_order_relaxed);
+    logCrashDrain();
+    for (int i = 0; i < LOG_CRASH_SIGNALS_N; i++){
+        if (LOG_CRASH_SIGNALS[i] != sig)
+            continue;
+        #ifndef _WIN32
+            sigaction(sig, &log_old_actions[i], nullptr);
+        #else
+            signal(sig, log_old_handlers[i]);
+        #endif
+    }
+    raise(sig);
+}
+
+static void logInstallCrashHandler(){
+    static std::once_flag installed;
+    std::call_once(installed, [](){
+        for (int i = 0; i < LOG_CRASH_SIGNALS_N; i++){
+            #ifndef _WIN32
+                struct sigaction action = {};
+                action.sa_handler = logCrashHandler;
+                sigemptyset(&action.sa_mask);
+                sigaction(LOG_CRASH_SIGNALS[i], &action, &log_old_actions[i]);
+            #else
+                log_old_handlers[i] = signal(LOG_CRASH_SIGNALS[i], logCrashHandler);
+            #endif
+        }
+    });
+}
+
+void logStartAsync(){
+    std::lock_guard<std::mutex> lock(log_control_mutex);
+    if (log_async.load(std::memory_order_relaxed))
+        return;
+
+    fflush(_logfile);
+    fflush(stderr);
+    logInstallCrashHandler();
+    log_stop .store(false, std::memory_order_relaxed);
+    log_async.store(true , std::memory_order_release);
+    log_writer = new std::thread(logWriterLoop);
+}
+
+void logStopAsync(){
+    std::lock_guard<std::mutex> lock(log_control_mutex);
+    if (log_writer == nullptr)
+        return;
+
+    log_stop.store(true, std::memory_order_release);
+    log_writer->join();
+    delete log_writer;
+    log_writer = nullptr;
+    log_async.store(false, std::memory_order_release);
+    logDrainAll();
+}
+
+void logFlush(){
+    if (log_async.load(std::memory_order_acquire))
+        logDrainAll();
+}
+
+static void logWrite(const char* msg, size_t len, size_t prefix_len, consoleColor text_color, consoleColor back_color){
+    if (log_async.load(std::memory_order_acquire)){
+        if (logRingPush(msg, len, prefix_len, text_color, back_color))
+            return;
+        logFlush();
+    }
+
+    if (text_color == LOG_RECORD_BINARY){
+        std::lock_guard<std::mutex> lock(log_binfile_mutex);
+        if (log_binfile != nullptr)
+            fwrite(msg, 1, len, log_binfile);
+        return;
+    }
+
+    fwrite(msg, 1, len, _logfile);
+    setConsoleColor(stderr, text_color, back_color);
+    fwrite(msg + prefix_len, 1, len - prefix_len, stderr);
     setConsoleColor(stderr, COLOR_DEFAULTT, COLOR_BLACK);
+}
+
+static void log_vmessage(consoleColor text_color, consoleColor back_color, bool timestamp,
+                         const char* tag, const char* format, va_list args){
+    static thread_local char staging[LOG_MAX_RECORD];
+
+    size_t prefix_len = 0;
+    if (timestamp)
+        prefix_len = sprint_timestamp(staging, LOG_MAX_RECORD);
+    size_t len = prefix_len;
+    if (tag != nullptr){
+        size_t tag_len = strlen(tag);
+        memcpy(staging + len, tag, tag_len);
+        len += tag_len;
+    }
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int msg_len = vsnprintf(staging + len, LOG_MAX_RECORD - len, format, args);
+    if (msg_len >= 0 && len + msg_len < LOG_MAX_RECORD){
+        logWrite(staging, len + msg_len, prefix_len, text_color, back_color);
+    }
+    else if (msg_len >= 0){
+        char* msg = (char*)malloc(len + msg_len + 1);
+        if (msg != nullptr){
+            memcpy(msg, staging, len);
+            vsnprintf(msg + len, msg_len + 1, format, args_copy);
+            logWrite(msg, len + msg_len, prefix_len, text_color, back_color);
+            free(msg);
+        }
+    }
+    va_end(args_copy);
+}
+
+void log_message_(consoleColor text_color, consoleColor back_color, bool timestamp,
+                  const char* tag, const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    log_vmessage(text_color, back_color, timestamp, tag, format, args);
+    va_end(args);
+}
+
+
+//Binary mode
+
+struct LogFormat{
+    bool        timestamp;
+    std::string tag;
+    std::string format;
+};
+
+static std::mutex             log_formats_mutex;
+static std::vector<LogFormat> log_formats;
+
+static void logBinaryWrite(const char* rec, size_t len){
+    logWrite(rec, len, 0, (consoleColor)LOG_RECORD_BINARY, COLOR_BLACK);
+}
+
+bool logPackReserve(LogPacker* packer, size_t add){
+    static thread_local char staging[LOG_MAX_RECORD];
+
+    if (packer->failed)
+        return false;
+    if (packer->buf == nullptr){
+        packer->buf      = staging;
+        packer->capacity = LOG_MAX_RECORD;
+    }
+    if (packer->size + add <= packer->capacity)
+        return true;
+
+    size_t capacity = packer->capacity * 2;
+    while (capacity < packer->size + add)
+        capacity *= 2;
+    char* buf = (char*)malloc(capacity);
+    if (buf == nullptr){
+        packer->failed = true;
+        return false;
+    }
+    memcpy(buf, packer->buf, packer->size);
+    if (packer->heap)
+        free(packer->buf);
+    packer->buf      = buf;
+    packer->capacity = capacity;
+    packer->heap     = true;
+    return true;
+}
+
+static void logPackEnd(LogPacker* packer){
+    if (!packer->failed)
+        logBinaryWrite(packer->buf, packer->size);
+    if (packer->heap)
+        free(packer->buf);
+}
+
+static void logPackFormat(LogPacker* packer, uint32_t id, const LogFormat* format){
+    logPackValue(packer, (uint8_t)LOG_BIN_FORMAT);
+    logPackValue(packer, id);
+    logPackValue(packer, (uint8_t)format->timestamp);
+    logPackValue(packer, (uint16_t)format->tag.size());
+    logPackValue(packer, (uint32_t)format->format.size());
+    logPackBytes(packer, format->tag.data()   , format->tag.size());
+    logPackBytes(packer, format->format.data(), format->format.size());
+}
+
+//'%' in file or function names must not be taken for a conversion
+static void logAppendEscaped(std::string* str, const char* text){
+    for (; *text != '\0'; text++){
+        if (*text == '%')
+            str->push_back('%');
+        str->push_back(*text);
+    }
+}
+
+uint32_t logFormatId_(bool timestamp, const char* tag, const char* format,
+                      const char* file, int line, const char* func){
+    LogFormat fmt = {timestamp, (tag != nullptr)? tag : "", (format != nullptr)? format : ""};
+    if (file != nullptr){
+        fmt.format += " at: \nFile:";
+        logAppendEscaped(&fmt.format, file);
+        fmt.format += " \nLine:" + std::to_string(line) + " \nFunc:";
+        logAppendEscaped(&fmt.format, func);
+        fmt.format += "\n";
+    }
+
+    std::lock_guard<std::mutex> lock(log_formats_mutex);
+    uint32_t id = (uint32_t)log_formats.size();
+    log_formats.push_back(fmt);
+    if (log_binfile != nullptr){
+        LogPacker packer = {};
+        logPackFormat(&packer, id, &log_formats.back());
+        logPackEnd(&packer);
+    }
+    return id;
+}
+
+uint64_t logStrArgs_(const char* format){
+    uint64_t mask  = 0;
+    size_t   index = 0;
+    for (const char* ch = format; *ch != '\0'; ch++){
+        if (*ch != '%')
+            continue;
+        ch++;
+        if (*ch == '%')
+            continue;
+        for (; *ch != '\0' && strchr("diouxXeEfFgGaAcspn", *ch) == nullptr; ch++){
+            if (*ch == '*')
+                index++;
+        }
+        if (*ch == '\0')
+            break;
+        if (*ch == 's' && index < 64)
+            mask |= (uint64_t)1 << index;
+        index++;
+    }
+    return mask;
+}
+
+static const size_t LOG_BIN_ARGS_SIZE_POS = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(int64_t);
+
+void logBinaryBegin_(LogPacker* packer, uint32_t id){
+    logPackValue(packer, (uint8_t)LOG_BIN_MESSAGE);
+    logPackValue(packer, id);
+    logPackValue(packer, wallTimeNs());
+    logPackValue(packer, (uint32_t)0);
+}
+
+void logBinaryEnd_(LogPacker* packer){
+    if (!packer->failed){
+        uint32_t args_size = (uint32_t)(packer->size - LOG_BIN_ARGS_SIZE_POS - sizeof(uint32_t));
+        memcpy(packer->buf + LOG_BIN_ARGS_SIZE_POS, &args_size, sizeof(args_size));
+    }
+    logPackEnd(packer);
+}
+
+void logBinaryElems_(uint32_t id, const void* data, size_t elem_size, size_t size, size_t first, size_t count,
+                     const void* poison, bool compress_poison){
+    LogPacker packer = {};
+    logPackValue(&packer, (uint8_t)LOG_BIN_ELEMS);
+    logPackValue(&packer, id);
+    logPackValue(&packer, (uint32_t)elem_size);
+    logPackValue(&packer, (uint64_t)size);
+    logPackValue(&packer, (uint64_t)first);
+    logPackValue(&packer, (uint64_t)count);
+    logPackValue(&packer, (uint8_t)compress_poison);
+    logPackBytes(&packer, poison, elem_size);
+    logPackBytes(&packer, (const char*)data + first * elem_size, elem_size * count);
+    logPackEnd(&packer);
+}
+
+bool logStartBinary(const char* path){
+    std::lock_guard<std::mutex> lock(log_formats_mutex);
+    if (log_binfile != nullptr)
+        return true;
+
+    FILE* binfile = fopen(path, "ab");
+    if (binfile == nullptr){
+        perror("Error opening binary log file");
+        return false;
+    }
+    setvbuf(binfile, nullptr, _IONBF, 0);
+    fwrite(LOG_BIN_MAGIC, 1, LOG_BIN_MAGIC_LEN, binfile);
+    {
+        std::lock_guard<std::mutex> file_lock(log_binfile_mutex);
+        log_binfile = binfile;
+        log_binfd.store(fileno(binfile), std::memory_order_relaxed);
+    }
+
+    //formats registered before this run of the file
+    for (size_t id = 0; id < log_formats.size(); id++){
+        LogPacker packer = {};
+        logPackFormat(&packer, (uint32_t)id, &log_formats[id]);
+        logPackEnd(&packer);
+    }
+    _log_binary.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+//records logged meanwhile by other threads are written before the file is closed or dropped
+void logStopBinary(){
+    std::lock_guard<std::mutex> lock(log_formats_mutex);
+    if (log_binfile == nullptr)
+        return;
+    _log_binary.store(false, std::memory_order_relaxed);
+    logFlush();
 
+    std::lock_guard<std::mutex> file_lock(log_binfile_mutex);
+    //a drain took log_binfd before it is reset
+    while (log_draining.exchange(true, std::memory_order_acquire))
+        std::this_thread::yield();
+    log_in_drain = true;
+    log_binfd.store(-1, std::memory_order_relaxed);
+    fclose(log_binfile);
+    log_binfile = nullptr;
+    log_in_drain = false;
+    log_draining.store(false, std::memory_order_release);
 }
 
-void printf_log(const char* format, ...){
+#ifndef _WIN32
+    static void logSignalWriteFd(int fd, const char* text, size_t len){
+        while (len > 0){
+            ssize_t written = write(fd, text, len);
+            if (written < 0){
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            text += written;
+            len  -= written;
+        }
+    }
+#endif
+
+void logSignalWrite(const char* text){
+    size_t len = 0;
+    while (text[len] != '\0')
+        len++;
+    #ifndef _WIN32
+        int saved_errno = errno;
+        if (log_fd != -1)
+            logSignalWriteFd(log_fd, text, len);
+        logSignalWriteFd(LOG_STDERR_FD, text, len);
+        errno = saved_errno;
+    #else
+        fwrite(text, 1, len, _logfile);
+        fwrite(text, 1, len, stderr);
+    #endif
+}
+
+void logSignalWriteNum(uint64_t value, unsigned base){
+    static const char digits[] = "0123456789abcdef";
+    char buf[2 + 64 + 1] = {};
+    char* pos = buf + sizeof(buf) - 1;
+    do{
+        *--pos = digits[value % base];
+        value /= base;
+    } while (value != 0);
+    if (base == 16){
+        *--pos = 'x';
+        *--pos = '0';
+    }
+    logSignalWrite(pos);
+}
+
+void printVarInfo_log(const VarInfo *var){
+    if(var != nullptr){
+        printf_log("     Variable info:     Name: %s\n"
+                   "                      Status: %s\n"
+                   "                  Created at: %s :%d\n"
+                   "                 In function: %s\n",
+        strPrintable(var->name), varstatusAsString(var->status) , strPrintable(var->file), var->line, strPrintable(var->func));
+    }
+    else{
+        printf_log("     Variable info: info is nullptr\n");
+    }
+}
+
+void printf_log_(const char* format, ...){
     va_list args;
-    va_start(args, max_print_args);
-    setConsoleColor(stderr, COLOR_WHITE, COLOR_BLACK);
-    vfprintf(_logfile, format , args);
-    vfprintf( stderr , format , args);
-    setConsoleColor(stderr, (consoleColor)(COLOR_WHITE | COLOR_INTENSE), COLOR_BLACK);
+    va_start(args, format);
+    log_vmessage(COLOR_WHITE, COLOR_BLACK, false, nullptr, format, args);
     va_end(args);
 }
 
-void warn_log(const char* format, ...){
+void warn_log_(const char* format, ...){
     va_list args;
-    va_start(args, max_print_args);
-    setConsoleColor(stderr, (consoleColor)(COLOR_YELLOW | COLOR_INTENSE), COLOR_BLACK);
-    fprint_time_nodate(_logfile, time(nullptr));
-    fprintf(_logfile, "[WARN]");
-    fprintf( stderr , "[WARN]");
-    vfprintf(_logfile, format , args);
-    vfprintf( stderr , format , args);
-    setConsoleColor(stderr, (consoleColor)(COLOR_WHITE | COLOR_INTENSE), COLOR_BLACK);
+    va_start(args, format);
+    log_vmessage((consoleColor)(COLOR_YELLOW | COLOR_INTENSE), COLOR_BLACK, true, "[WARN]", format, args);
     va_end(args);
 }
-void info_log(const char* format, ...){
+
+void info_log_(const char* format, ...){
     va_list args;
-    va_start(args, max_print_args);
-    setConsoleColor(stderr, (consoleColor)(COLOR_WHITE), COLOR_BLACK);
-    fprint_time_nodate(_logfile, time(nullptr));
-    fprintf(_logfile, "[info]");
-    fprintf( stderr , "[info]");
-    vfprintf(_logfile, format , args);
-    vfprintf( stderr , format , args);
-    setConsoleColor(stderr, (consoleColor)(COLOR_WHITE | COLOR_INTENSE), COLOR_BLACK);
+    va_start(args, format);
+    log_vmessage(COLOR_WHITE, COLOR_BLACK, true, "[info]", format, args);
     va_end(args);
 }
 
-void debug_log(const char* format, ...){
+void debug_log_(const char* format, ...){
     va_list args;
-    va_start(args, max_print_args);
-    setConsoleColor(stderr, COLOR_MAGENTA, COLOR_BLACK);
-    fprint_time_nodate(_logfile, time(nullptr));
-    fprintf(_logfile, "[DEBUG]");
-    fprintf( stderr , "[DEBUG]");
-    vfprintf(_logfile, format , args);
-    vfprintf( stderr , format , args);
-    setConsoleColor(stderr, (consoleColor)(COLOR_WHITE | COLOR_INTENSE), COLOR_BLACK);
+    va_start(args, format);
+    log_vmessage(COLOR_MAGENTA, COLOR_BLACK, true, "[DEBUG]", format, args);
     va_end(args);
 }
-void dumpData(const void* begin_ptr, size_t max_size){
-    printf_log("     Raw data dump: (%ld total) [ ", max_size);
-    size_t i = 0;
-    while (i < max_size){
-        if(!IsBadReadPtr((char*)begin_ptr + i, 1)){
-            printf_log("%p ", ((uint8_t*)begin_ptr)[i]);
+
+void logBufPrintf(LogTextBuf* buf, const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    va_list args_copy;
+    va_copy(args_copy, args);
+
+    size_t free_size = buf->capacity - buf->size;
+    int len = vsnprintf(buf->buf + buf->size, free_size, format, args);
+    if (len >= 0 && (size_t)len >= free_size){
+        size_t capacity = (buf->capacity == 0)? LOG_MAX_RECORD : buf->capacity * 2;
+        while (capacity < buf->size + len + 1)
+            capacity *= 2;
+        char* new_buf = (char*)realloc(buf->buf, capacity);
+        if (new_buf != nullptr){
+            buf->buf      = new_buf;
+            buf->capacity = capacity;
+            vsnprintf(buf->buf + buf->size, capacity - buf->size, format, args_copy);
         }
         else{
-            printf_log("|access denied| ");
+            len = -1;
+        }
+    }
+    if (len > 0)
+        buf->size += len;
+
+    va_end(args_copy);
+    va_end(args);
+}
+
+void logBufFlush(LogTextBuf* buf){
+    if (buf->size == 0)
+        return;
+    if (LOG_BINARY_ON)
+        printf_log("%s", buf->buf);
+    else
+        logWrite(buf->buf, buf->size, 0, COLOR_WHITE, COLOR_BLACK);
+    buf->size = 0;
+}
+
+void logBufFree(LogTextBuf* buf){
+    free(buf->buf);
+    buf->buf      = nullptr;
+    buf->size     = 0;
+    buf->capacity = 0;
+}
+
+static const size_t DUMP_PAGE_SIZE = 4096; //smallest page size, readability can only change on its boundary
+static const size_t DUMP_LINE      = 16;
+
+static void dumpDataRange(LogTextBuf* buf, const uint8_t* begin, size_t from, size_t to, bool all_readable){
+    if (from >= to)
+        return;
+    uintptr_t checked_page = UINTPTR_MAX;
+    bool      page_bad     = false;
+    for (size_t i = from; i < to; i++){
+        if ((i - from) % DUMP_LINE == 0)
+            logBufPrintf(buf, "%s      %p:", (i == from)? "" : "\n", begin + i);
+
+        uintptr_t addr = (uintptr_t)(begin + i);
+        if (!all_readable && (addr & ~(DUMP_PAGE_SIZE - 1)) != checked_page){
+            checked_page = addr & ~(DUMP_PAGE_SIZE - 1);
+            size_t rest  = checked_page + DUMP_PAGE_SIZE - addr;
+            page_bad     = isBadReadPtr((const void*)addr, (rest < to - i)? rest : to - i);
         }
-        i++;
+        if (all_readable || !page_bad)
+            logBufPrintf(buf, " %02x", begin[i]);
+        else
+            logBufPrintf(buf, " ??");
     }
-    printf_log("]\n");
+    logBufPrintf(buf, "\n");
+}
+
+void dumpData(const void* begin_ptr, size_t max_size, size_t max_shown){
+    LogTextBuf buf = {};
+    logBufPrintf(&buf, "     Raw data dump: (%zu total)\n", max_size);
+
+    //whole range is checked once, page by page only if some of it is not readable
+    bool all_readable = !isBadReadPtr(begin_ptr, max_size);
+    const uint8_t* begin = (const uint8_t*)begin_ptr;
+
+    if (max_size <= max_shown){
+        dumpDataRange(&buf, begin, 0, max_size, all_readable);
+    }
+    else{
+        size_t half = max_shown / 2;
+        dumpDataRange(&buf, begin, 0, half, all_readable);
+        logBufPrintf(&buf, "      ... %zu bytes skipped\n", max_size - 2 * half);
+        dumpDataRange(&buf, begin, max_size - half, max_size, all_readable);
+    }
+
+    logBufFlush(&buf);
+    logBufFree(&buf);
 }
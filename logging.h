@@ -5,69 +5,184 @@
     #include <time.h>
     #include <string.h>
     #include <stdarg.h>
+    #include <atomic>
 
     #include "Console_utils.h"
     #include "asserts.h"
     #include "time_utils.h"
     #include "debug_utils.h"
+    #include "log_binary.h"
 
     extern FILE* _logfile;
 
+    enum logLevel_t{
+        LOG_LEVEL_DEBUG = 0,
+        LOG_LEVEL_INFO  = 1,
+        LOG_LEVEL_WARN  = 2,
+        LOG_LEVEL_ERROR = 3,
+        LOG_LEVEL_OFF   = 4
+    };
+
+    //messages below LOG_MIN_LEVEL are compiled out, arguments are not evaluated
+    #ifndef LOG_MIN_LEVEL
+        #define LOG_MIN_LEVEL 0
+    #endif
 
-    void printf_log(const char* format, ...);
+    //runtime filter, messages below it cost one compare
+    extern logLevel_t _log_level;
 
-    void perror_log_(const char* errmsg, const char* add_info);
+    void setLogLevel(logLevel_t level);
 
-    void warn_log(const char* format, ...);
+    #ifdef LOG_ENABLED
+        #error redefinition of internal macro LOG_ENABLED
+    #endif
+    #define LOG_ENABLED(level) ((level) >= LOG_MIN_LEVEL && (level) >= _log_level)
 
-    void info_log(const char* format, ...);
+    //Async mode: messages are formatted on the caller's thread into a per-thread ring buffer,
+    //a background thread writes them out in batches. Order is kept per thread.
+    //Rings are flushed on logStopAsync (called at exit) and on SIGSEGV/SIGABRT/SIGFPE/SIGILL.
+    void logStartAsync();
 
-    void debug_log(const char* format, ...);
+    void logStopAsync();
 
-    #ifdef error_log
-        #error redefinition of internal macro error_log perror_log
+    //writes out everything already logged
+    void logFlush();
+
+    //formats once, writes timestamp (file only) + tag + message
+    void log_message_(consoleColor text_color, consoleColor back_color, bool timestamp,
+                      const char* tag, const char* format, ...);
+
+
+    //Binary mode: messages go to a separate file as format id + raw arguments, nothing is
+    //formatted or printed to the console. Rendered later by logdecode. Stopped at exit
+    extern std::atomic<bool> _log_binary;
+
+    #ifdef LOG_BINARY_ON
+        #error redefinition of internal macro LOG_BINARY_ON
+    #endif
+    #define LOG_BINARY_ON (_log_binary.load(std::memory_order_relaxed))
+
+    bool logStartBinary(const char* path);
+
+    void logStopBinary();
+
+
+    //continues the previous message: not filtered by level, so a caller that writes several
+    //lines checks LOG_ENABLED once for all of them (see stackDump)
+    void printf_log_(const char* format, ...);
+
+    void warn_log_(const char* format, ...);
+
+    void info_log_(const char* format, ...);
+
+    void debug_log_(const char* format, ...);
+
+    #ifdef LOG_FIRST_ARG
+        #error redefinition of internal macro LOG_FIRST_ARG
+    #endif
+    #define LOG_FIRST_ARG_(first, ...) first
+    #define LOG_FIRST_ARG(...) LOG_FIRST_ARG_(__VA_ARGS__, 0)
+
+    //format is registered once per call site
+    #ifdef LOG_BINARY
+        #error redefinition of internal macro LOG_BINARY
+    #endif
+    #define LOG_BINARY(timestamp, tag, format, file, line, func, ...) {                          \
+        static const LogCallSite log_site_ = {logFormatId_(timestamp, tag, format, file, line, func), \
+                                              logStrArgs_(format)};                             \
+        logBinary_(&log_site_, __VA_ARGS__);                                                    \
+    }
+
+    #ifdef printf_log
+        #error redefinition of internal macro printf_log
     #endif
-    #define perror_log(errmsg)  do {    \
-        setConsoleColor(stderr, (consoleColor)(COLOR_RED | COLOR_INTENSE), COLOR_BLACK); \
-        fprint_time_nodate(_logfile, time(nullptr));                                     \
-        fprintf(_logfile, "[ERROR] %s :%s\n at: \nFile:%s \nLine:%d \nFunc:%s\n",        \
-                  errmsg, strerror(errno), __FILE__, __LINE__, __PRETTY_FUNCTION__);     \
-        fprintf(stderr  , "[ERROR] %s :%s\n at: \nFile:%s \nLine:%d \nFunc:%s\n",        \
-                  errmsg, strerror(errno), __FILE__, __LINE__, __PRETTY_FUNCTION__);     \
-        setConsoleColor(stderr, (consoleColor)(COLOR_WHITE | COLOR_INTENSE), COLOR_BLACK);\
+    #define printf_log(...) do {                                                                 \
+        if (LOG_BINARY_ON)                                                                       \
+            LOG_BINARY(false, nullptr, LOG_FIRST_ARG(__VA_ARGS__), nullptr, 0, nullptr, __VA_ARGS__) \
+        else                                                                                     \
+            printf_log_(__VA_ARGS__);                                                            \
+    } while(0)
+
+    #ifdef warn_log
+        #error redefinition of internal macro warn_log
+    #endif
+    #define warn_log(...) do {                                                                   \
+        if (LOG_ENABLED(LOG_LEVEL_WARN)){                                                        \
+            if (LOG_BINARY_ON)                                                                   \
+                LOG_BINARY(true, "[WARN]", LOG_FIRST_ARG(__VA_ARGS__), nullptr, 0, nullptr, __VA_ARGS__) \
+            else                                                                                 \
+                warn_log_(__VA_ARGS__);                                                          \
+        }                                                                                        \
+    } while(0)
+
+    #ifdef info_log
+        #error redefinition of internal macro info_log
+    #endif
+    #define info_log(...) do {                                                                   \
+        if (LOG_ENABLED(LOG_LEVEL_INFO)){                                                        \
+            if (LOG_BINARY_ON)                                                                   \
+                LOG_BINARY(true, "[info]", LOG_FIRST_ARG(__VA_ARGS__), nullptr, 0, nullptr, __VA_ARGS__) \
+            else                                                                                 \
+                info_log_(__VA_ARGS__);                                                          \
+        }                                                                                        \
+    } while(0)
+
+    #ifdef debug_log
+        #error redefinition of internal macro debug_log
+    #endif
+    #define debug_log(...) do {                                                                  \
+        if (LOG_ENABLED(LOG_LEVEL_DEBUG)){                                                       \
+            if (LOG_BINARY_ON)                                                                   \
+                LOG_BINARY(true, "[DEBUG]", LOG_FIRST_ARG(__VA_ARGS__), nullptr, 0, nullptr, __VA_ARGS__) \
+            else                                                                                 \
+                debug_log_(__VA_ARGS__);                                                         \
+        }                                                                                        \
+    } while(0)
+
+    #ifdef perror_log
+        #error redefinition of internal macro perror_log
+    #endif
+    #define perror_log(errmsg)  do {                                                             \
+        if (LOG_ENABLED(LOG_LEVEL_ERROR)){                                                       \
+            if (LOG_BINARY_ON)                                                                   \
+                LOG_BINARY(true, "[ERROR] ", "%s :%s\n", __FILE__, __LINE__, __PRETTY_FUNCTION__,\
+                           "%s :%s\n", errmsg, strerror(errno))                                  \
+            else                                                                                 \
+                log_message_((consoleColor)(COLOR_RED | COLOR_INTENSE), COLOR_BLACK, true,       \
+                             "[ERROR] ", "%s :%s\n at: \nFile:%s \nLine:%d \nFunc:%s\n",         \
+                             errmsg, strerror(errno), __FILE__, __LINE__, __PRETTY_FUNCTION__);  \
+        }                                                                                        \
     } while(0)
 
     #ifdef error_log
         #error redefinition of internal macro error_log
     #endif
-    #define error_log(format, ...) {                                                     \
-        setConsoleColor(stderr, (consoleColor)(COLOR_RED | COLOR_INTENSE), COLOR_BLACK);   \
-        fprint_time_nodate(_logfile, time(nullptr));                                       \
-        fprintf(_logfile, "[ERROR]" format , __VA_ARGS__);                                 \
-        fprintf(stderr  , "[ERROR]" format , __VA_ARGS__);                                 \
-        fprintf(_logfile, " at: \nFile:%s \nLine:%d \nFunc:%s\n",                          \
-                   __FILE__, __LINE__, __PRETTY_FUNCTION__);       \
-        fprintf(stderr  , " at: \nFile:%s \nLine:%d \nFunc:%s\n",                          \
-                   __FILE__, __LINE__, __PRETTY_FUNCTION__);       \
-        setConsoleColor(stderr, COLOR_DEFAULTT, COLOR_BLACK);      \
+    #define error_log(format, ...) {                                                             \
+        if (LOG_ENABLED(LOG_LEVEL_ERROR)){                                                       \
+            if (LOG_BINARY_ON)                                                                   \
+                LOG_BINARY(true, "[ERROR]", format, __FILE__, __LINE__, __PRETTY_FUNCTION__,     \
+                           format, __VA_ARGS__)                                                  \
+            else                                                                                 \
+                log_message_((consoleColor)(COLOR_RED | COLOR_INTENSE), COLOR_BLACK, true,       \
+                             "[ERROR]", format " at: \nFile:%s \nLine:%d \nFunc:%s\n",            \
+                             __VA_ARGS__, __FILE__, __LINE__, __PRETTY_FUNCTION__);              \
+        }                                                                                        \
     }
 
     #ifdef assert_log
         #error redefinition of internal macro assert_log
     #endif
     #ifndef NDEBUG
-        #define assert_log(cond)                                  \
-        if(!(cond)){                                                 \
-            setConsoleColor(stderr, COLOR_WHITE, COLOR_RED);           \
-            fprint_time_nodate(_logfile, time(nullptr));               \
-            fprintf(_logfile, "[ASSERT]" #cond);                       \
-            fprintf(stderr  , "[ASSERT]" #cond);                       \
-            fprintf(_logfile, " at: \nFile:%s \nLine:%d \nFunc:%s\n",  \
-                       __FILE__, __LINE__, __PRETTY_FUNCTION__);       \
-            fprintf(stderr  , " at: \nFile:%s \nLine:%d \nFunc:%s\n",  \
-                       __FILE__, __LINE__, __PRETTY_FUNCTION__);       \
-            setConsoleColor(stderr, COLOR_DEFAULTT, COLOR_BLACK);      \
-            exit(EXIT_FAILURE);                                        \
+        #define assert_log(cond)                                                    \
+        if(!(cond)){                                                                \
+            if (LOG_BINARY_ON)                                                      \
+                LOG_BINARY(true, "[ASSERT]", "%s", __FILE__, __LINE__,              \
+                           __PRETTY_FUNCTION__, "%s", #cond)                        \
+            else                                                                    \
+                log_message_(COLOR_WHITE, COLOR_RED, true,                          \
+                             "[ASSERT]", #cond " at: \nFile:%s \nLine:%d \nFunc:%s\n",   \
+                             __FILE__, __LINE__, __PRETTY_FUNCTION__);              \
+            exit(EXIT_FAILURE);                                                     \
         }
     #else
         #define assert_log(cond) ;
@@ -82,8 +197,33 @@
     }
 
 
+    //text collected in memory and written out with one printf_log (dumps)
+    struct LogTextBuf{
+        char*  buf;
+        size_t size;
+        size_t capacity;
+    };
+
+    void logBufPrintf(LogTextBuf* buf, const char* format, ...);
+
+    //writes collected text and empties the buffer
+    void logBufFlush(LogTextBuf* buf);
+
+    void logBufFree(LogTextBuf* buf);
+
+
+    //async-signal-safe output for signal handlers: write(2) to the log file and stderr,
+    //no formatting, stdio or locks. Bypasses async rings, so may come before earlier messages
+    void logSignalWrite(const char* text);
+
+    //base 10 or 16 (with 0x)
+    void logSignalWriteNum(uint64_t value, unsigned base);
+
+
     void printVarInfo_log(const VarInfo *var);
 
-    void dumpData(const void* begin_ptr, size_t max_size);
+    //hexdump, unreadable bytes are shown as ??. If max_size > max_shown, only
+    //max_shown / 2 bytes from the begin and from the end are shown
+    void dumpData(const void* begin_ptr, size_t max_size, size_t max_shown);
 
 #endif // LOGGING_H_INCLUDED
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#ifdef _WIN32
+    #include <windows.h>
+#endif
+
+#ifdef __linux__
+    #include <errno.h>
+    #include <unistd.h>
+    #include <sys/uio.h>
+#endif
+
+#include "ptr_utils.h"
+#include "time_utils.h"
+
+//read by every check on any thread
+static std::atomic<ptrCheckMode_t> ptr_check_mode {PTR_CHECK_TRACKED};
+
+void setPtrCheckMode(ptrCheckMode_t mode){
+    ptr_check_mode.store(mode, std::memory_order_relaxed);
+}
+
+ptrCheckMode_t getPtrCheckMode(){
+    return ptr_check_mode.load(std::memory_order_relaxed);
+}
+
+
+//Registry: open addressing table keyed by block begin, lock-free
+static const int       PTR_TRACK_LOG       = 16;
+static const size_t    PTR_TRACK_CAPACITY  = (size_t)1 << PTR_TRACK_LOG;
+static const int       PTR_TRACK_MAX_PROBE = 64;
+static const uintptr_t PTR_TRACK_EMPTY     = 0;
+static const uintptr_t PTR_TRACK_REMOVED   = 1;
+
+struct PtrTrackEntry{
+    std::atomic<uintptr_t> begin;
+    std::atomic<size_t>    size;
+};
+
+static PtrTrackEntry ptr_track[PTR_TRACK_CAPACITY];
+
+static size_t ptrTrackSlot(uintptr_t ptr){
+    return (size_t)(((ptr >> 4) * 0x9E3779B97F4A7C15ull) >> (64 - PTR_TRACK_LOG));
+}
+
+static PtrTrackEntry* ptrTrackFind(uintptr_t ptr){
+    size_t slot = ptrTrackSlot(ptr);
+    for (int i = 0; i < PTR_TRACK_MAX_PROBE; i++){
+        PtrTrackEntry* entry = &ptr_track[(slot + i) & (PTR_TRACK_CAPACITY - 1)];
+        uintptr_t begin = entry->begin.load(std::memory_order_acquire);
+        if (begin == ptr)
+            return entry;
+        if (begin == PTR_TRACK_EMPTY)
+            return nullptr;
+    }
+    return nullptr;
+}
+
+bool ptrTrack(const void* ptr, size_t size){
+    if ((uintptr_t)ptr <= PTR_TRACK_REMOVED)
+        return false;
+
+    PtrTrackEntry* entry = ptrTrackFind((uintptr_t)ptr);
+    if (entry != nullptr){
+        entry->size.store(size, std::memory_order_release);
+        return true;
+    }
+
+    size_t slot = ptrTrackSlot((uintptr_t)ptr);
+    for (int i = 0; i < PTR_TRACK_MAX_PROBE; i++){
+        entry = &ptr_track[(slot + i) & (PTR_TRACK_CAPACITY - 1)];
+        uintptr_t begin = entry->begin.load(std::memory_order_relaxed);
+        if (begin != PTR_TRACK_EMPTY && begin != PTR_TRACK_REMOVED)
+            continue;
+        //size is set first: a reader that sees the new begin never gets size of the previous block
+        entry->size.store(0, std::memory_order_relaxed);
+        if (entry->begin.compare_exchange_strong(begin, (uintptr_t)ptr, std::memory_order_acq_rel)){
+            entry->size.store(size, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ptrUntrack(const void* ptr){
+    PtrTrackEntry* entry = ptrTrackFind((uintptr_t)ptr);
+    if (entry == nullptr)
+        return;
+    entry->size.store(0, std::memory_order_relaxed);
+    entry->begin.store(PTR_TRACK_REMOVED, std::memory_order_release);
+}
+
+static bool ptrTracked(const void* ptr, size_t size){
+    PtrTrackEntry* entry = ptrTrackFind((uintptr_t)ptr);
+    return entry != nullptr && size <= entry->size.load(std::memory_order_acquire);
+}
+
+
+#if defined(_WIN32)
+
+static bool sysBadReadPtr(const void* ptr, size_t size){
+    return IsBadReadPtr(ptr, size);
+}
+static bool sysBadWritePtr(void* ptr, size_t size){
+    return IsBadWritePtr(ptr, size);
+}
+
+void ptrMapsInvalidate(){
+}
+
+#elif defined(__linux__)
+
+//copy of /proc/self/maps, sorted by address. Readers use it under a seqlock, so a check
+//is a binary search with no locks and no syscalls. Reread when a range is not found, when it
+//is stale (ptrMapsInvalidate) or old: a hit in a range unmapped by someone else is a false
+//negative until then. Ranges past PTR_MAPS_MAX are not loaded, addresses above the last
+//loaded one are then never reported as bad
+static const int      PTR_MAPS_MAX        = 8192;
+static const int      PTR_MAPS_TRIES      = 100;
+static const uint64_t PTR_MAPS_MAX_AGE_MS = 100;
+static const unsigned PTR_MAPS_AGE_EVERY  = 64; //checks on a thread between clock reads
+static const int      PTR_PROBE_IOV       = 64; //pages probed by one process_vm_readv
+
+enum ptrMapsProt_t{
+    PTR_PROT_READ  = 1,
+    PTR_PROT_WRITE = 2
+};
+
+struct PtrMapsRange{
+    std::atomic<uintptr_t> begin;
+    std::atomic<uintptr_t> end;
+    std::atomic<int>       prot;
+};
+
+static PtrMapsRange          ptr_maps[PTR_MAPS_MAX];
+static std::atomic<int>      ptr_maps_count   {0};
+static std::atomic<uintptr_t> ptr_maps_limit  {UINTPTR_MAX}; //end of the last range if file was cut
+static std::atomic<uint64_t> ptr_maps_version {0};
+static std::atomic<bool>     ptr_maps_stale   {true};
+static std::atomic<uint64_t> ptr_maps_load_ms {0};
+static std::mutex            ptr_maps_mutex;
+
+void ptrMapsInvalidate(){
+    ptr_maps_stale.store(true, std::memory_order_release);
+}
+
+static bool ptrMapsFresh(){
+    static thread_local unsigned checks = 0;
+    if (ptr_maps_stale.load(std::memory_order_acquire))
+        return false;
+    if (++checks % PTR_MAPS_AGE_EVERY != 0)
+        return true;
+    return monotonicTimeMs() - ptr_maps_load_ms.load(std::memory_order_relaxed) < PTR_MAPS_MAX_AGE_MS;
+}
+
+static void ptrMapsReload(){
+    std::lock_guard<std::mutex> lock(ptr_maps_mutex);
+
+    //an invalidation from now on is not lost: it may come before the file is read
+    ptr_maps_stale  .store(false, std::memory_order_relaxed);
+    ptr_maps_load_ms.store(monotonicTimeMs(), std::memory_order_relaxed);
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if (maps == nullptr){
+        ptr_maps_stale.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    ptr_maps_version.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    int count = 0;
+    char line[512] = "";
+    while (count < PTR_MAPS_MAX && fgets(line, sizeof(line), maps) != nullptr){
+        unsigned long begin = 0, end = 0;
+        char perms[5] = "";
+        if (sscanf(line, "%lx-%lx %4s", &begin, &end, perms) != 3)
+            continue;
+        int prot = 0;
+        if (perms[0] == 'r') prot |= PTR_PROT_READ;
+        if (perms[1] == 'w') prot |= PTR_PROT_WRITE;
+
+        ptr_maps[count].begin.store(begin, std::memory_order_relaxed);
+        ptr_maps[count].end  .store(end  , std::memory_order_relaxed);
+        ptr_maps[count].prot .store(prot , std::memory_order_relaxed);
+        count++;
+    }
+    uintptr_t limit = UINTPTR_MAX;
+    if (count == PTR_MAPS_MAX && fgets(line, sizeof(line), maps) != nullptr)
+        limit = ptr_maps[count - 1].end.load(std::memory_order_relaxed);
+    fclose(maps);
+    ptr_maps_count.store(count, std::memory_order_relaxed);
+    ptr_maps_limit.store(limit, std::memory_order_relaxed);
+
+    ptr_maps_version.fetch_add(1, std::memory_order_release);
+}
+
+//true if every byte of [begin, end) is in ranges with prot or above the ranges loaded
+static bool ptrMapsCovered(uintptr_t begin, uintptr_t end, int prot){
+    int       count = ptr_maps_count.load(std::memory_order_relaxed);
+    uintptr_t limit = ptr_maps_limit.load(std::memory_order_relaxed);
+
+    int lo = 0, hi = count;
+    while (lo < hi){
+        int mid = (lo + hi) / 2;
+        if (ptr_maps[mid].end.load(std::memory_order_relaxed) <= begin)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    uintptr_t covered = begin;
+    for (int i = lo; i < count && covered < end && covered < limit; i++){
+        if (ptr_maps[i].begin.load(std::memory_order_relaxed) > covered)
+            return false;
+        if ((ptr_maps[i].prot.load(std::memory_order_relaxed) & prot) != prot)
+            return false;
+        covered = ptr_maps[i].end.load(std::memory_order_relaxed);
+    }
+    return covered >= end || covered >= limit;
+}
+
+static bool ptrMapsCheck(const void* ptr, size_t size, int prot, bool* valid){
+    uintptr_t begin = (uintptr_t)ptr;
+    uintptr_t end   = begin + size;
+    if (end < begin){
+        *valid = false;
+        return true;
+    }
+    for (int i = 0; i < PTR_MAPS_TRIES; i++){
+        uint64_t version = ptr_maps_version.load(std::memory_order_acquire);
+        if (version & 1)
+            continue;
+        bool res = ptrMapsCovered(begin, end, prot);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (ptr_maps_version.load(std::memory_order_relaxed) == version){
+            *valid = res;
+            return true;
+        }
+    }
+    return false;
+}
+
+//1 if a byte of every page of [begin, end) can be read, 0 if not, -1 if probing is not allowed
+static int ptrProbeRead(uintptr_t begin, uintptr_t end){
+    static const uintptr_t page = sysconf(_SC_PAGESIZE);
+    char  scratch[PTR_PROBE_IOV];
+    iovec local = {scratch, 0};
+    iovec remote[PTR_PROBE_IOV];
+
+    uintptr_t pos = begin;
+    while (pos < end){
+        int count = 0;
+        for (; count < PTR_PROBE_IOV && pos < end; count++){
+            remote[count].iov_base = (void*)pos;
+            remote[count].iov_len  = 1;
+            pos = (pos | (page - 1)) + 1;
+        }
+        local.iov_len = count;
+        ssize_t copied = process_vm_readv(getpid(), &local, 1, remote, count, 0);
+        if (copied < 0)
+            return (errno == EFAULT)? 0 : -1;
+        if (copied != count)
+            return 0;
+    }
+    return 1;
+}
+
+static bool sysBadPtr(const void* ptr, size_t size, int prot){
+    bool valid = false;
+    if (ptrMapsFresh() && ptrMapsCheck(ptr, size, prot, &valid) && valid){
+        if (ptr_check_mode.load(std::memory_order_relaxed) != PTR_CHECK_PROBE)
+            return false;
+        //catches unmapped and PROT_NONE pages, write permission alone is taken from the cache
+        int readable = ptrProbeRead((uintptr_t)ptr, (uintptr_t)ptr + size);
+        if (readable != -1)
+            return readable == 0;
+    }
+    //memory may have been mapped, unmapped or protected after the last reload
+    ptrMapsReload();
+    if (ptrMapsCheck(ptr, size, prot, &valid))
+        return !valid;
+    return false; //maps are changing too often, do not report what we could not check
+}
+
+static bool sysBadReadPtr(const void* ptr, size_t size){
+    return sysBadPtr(ptr, size, PTR_PROT_READ);
+}
+static bool sysBadWritePtr(void* ptr, size_t size){
+    return sysBadPtr(ptr, size, PTR_PROT_READ | PTR_PROT_WRITE);
+}
+
+#else
+
+void ptrMapsInvalidate(){
+}
+
+static bool sysBadReadPtr(const void*, size_t){
+    return false;
+}
+static bool sysBadWritePtr(void*, size_t){
+    return false;
+}
+
+#endif
+
+
+bool isBadReadPtr(const void* ptr, size_t size){
+    if (ptr == nullptr)
+        return true;
+    if (size == 0)
+        return false;
+
+    switch (ptr_check_mode.load(std::memory_order_relaxed)){
+    case PTR_CHECK_OFF:
+        return false;
+    case PTR_CHECK_TRACKED:
+        if (ptrTracked(ptr, size))
+            return false;
+        return sysBadReadPtr(ptr, size);
+    default:
+        return sysBadReadPtr(ptr, size);
+    }
+}
+
+bool isBadWritePtr(void* ptr, size_t size){
+    if (ptr == nullptr)
+        return true;
+    if (size == 0)
+        return false;
+
+    switch (ptr_check_mode.load(std::memory_order_relaxed)){
+    case PTR_CHECK_OFF:
+        return false;
+    case PTR_CHECK_TRACKED:
+        if (ptrTracked(ptr, size))
+            return false;
+        return sysBadWritePtr(ptr, size);
+    default:
+        return sysBadWritePtr(ptr, size);
+    }
+}
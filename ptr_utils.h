@@ -0,0 +1,36 @@
+#ifndef PTR_UTILS_H_INCLUDED
+#define PTR_UTILS_H_INCLUDED
+
+#include <stddef.h>
+
+//Pointer validity checks, portable replacement for IsBadReadPtr/IsBadWritePtr.
+//Backends: Windows - IsBadReadPtr/IsBadWritePtr, Linux - cached /proc/self/maps
+//(reread when a pointer is not found in it, after ptrMapsInvalidate and about every 100 ms,
+//so memory unmapped by others may pass until then), others - only nullptr is bad.
+
+enum ptrCheckMode_t{
+    PTR_CHECK_OFF     = 0, //only nullptr is bad
+    PTR_CHECK_SYSTEM  = 1, //ask the system backend every time
+    PTR_CHECK_TRACKED = 2, //blocks registered with ptrTrack are trusted (O(1)), others go to the backend. Default
+    PTR_CHECK_PROBE   = 3  //as SYSTEM, but Linux cache hits are confirmed by copying a byte of every page with
+                           //process_vm_readv (a syscall per check). Lost write permission alone is still
+                           //seen only after ptrMapsInvalidate or the periodic reread
+};
+
+void           setPtrCheckMode(ptrCheckMode_t mode);
+ptrCheckMode_t getPtrCheckMode();
+
+//true if [ptr, ptr + size) can not be read / written
+bool isBadReadPtr (const void* ptr, size_t size);
+bool isBadWritePtr(      void* ptr, size_t size);
+
+//registry of library-owned blocks: a check of [ptr, ptr + n) with n <= size succeeds without
+//asking the system. Registry has fixed size, ptrTrack returns false when it is full
+//(block is then checked by the backend as usual)
+bool ptrTrack  (const void* ptr, size_t size);
+void ptrUntrack(const void* ptr);
+
+//mappings changed (munmap, mprotect): next check rereads them. Called by library allocators
+void ptrMapsInvalidate();
+
+#endif // PTR_UTILS_H_INCLUDED
@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <chrono>
+
+#include "time_utils.h"
 
 void fprint_mm_ss(FILE* file, time_t time){
     fprintf(file, "%02Id:%02Id", time/60, time%60);
@@ -18,3 +22,86 @@ void fprint_time_nodate(FILE* file, time_t time){
     tm* tm_time = localtime(&time);
     fprintf(file, "[%02d:%02d:%02d]", tm_time->tm_hour, tm_time->tm_min, tm_time->tm_sec);
 }
+
+int sprint_time_nodate(char* buf, size_t size, time_t time){
+    tm tm_time = {};
+    #ifdef _WIN32
+        localtime_s(&tm_time, &time);
+    #else
+        localtime_r(&time, &tm_time);
+    #endif
+    int res = snprintf(buf, size, "[%02d:%02d:%02d]", tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+    if (res < 0)
+        return 0;
+    return ((size_t)res < size)? res : (int)size - 1;
+}
+
+uint64_t monotonicTimeMs(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t monotonicTimeNs(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const uint64_t NS_PER_SEC = 1000000000;
+
+struct TimestampCache{
+    int64_t  sec;          //wall clock second in text, -1 before first use
+    uint64_t sec_start_ns; //monotonic time when that second began
+    char     text[11];     //"[hh:mm:ss."
+};
+
+static thread_local TimestampCache timestamp_cache = {-1, 0, {}};
+
+//monotonic time now, cache is refilled once a second has passed since the cached one began
+static uint64_t timestampNow(TimestampCache* cache){
+    uint64_t mono = monotonicTimeNs();
+    if (cache->sec >= 0 && mono - cache->sec_start_ns < NS_PER_SEC)
+        return mono;
+
+    int64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count();
+    mono = monotonicTimeNs();
+    cache->sec          = wall / (int64_t)NS_PER_SEC;
+    cache->sec_start_ns = mono - (uint64_t)(wall % (int64_t)NS_PER_SEC);
+
+    time_t sec = (time_t)cache->sec;
+    tm tm_time = {};
+    #ifdef _WIN32
+        localtime_s(&tm_time, &sec);
+    #else
+        localtime_r(&sec, &tm_time);
+    #endif
+    snprintf(cache->text, sizeof(cache->text), "[%02d:%02d:%02d.", tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+    return mono;
+}
+
+int64_t wallTimeNs(){
+    TimestampCache* cache = &timestamp_cache;
+    uint64_t mono = timestampNow(cache);
+    return cache->sec * (int64_t)NS_PER_SEC + (int64_t)(mono - cache->sec_start_ns);
+}
+
+int sprint_timestamp(char* buf, size_t size){
+    if (size == 0)
+        return 0;
+    TimestampCache* cache = &timestamp_cache;
+    uint64_t mono = timestampNow(cache);
+
+    char text[TIMESTAMP_LEN + 1];
+    memcpy(text, cache->text, sizeof(cache->text) - 1);
+    uint32_t usec = (uint32_t)((mono - cache->sec_start_ns) / 1000);
+    for (size_t i = TIMESTAMP_LEN - 2; i >= sizeof(cache->text) - 1; i--){
+        text[i] = (char)('0' + usec % 10);
+        usec /= 10;
+    }
+    text[TIMESTAMP_LEN - 1] = ']';
+
+    size_t len = (TIMESTAMP_LEN < size)? TIMESTAMP_LEN : size - 1;
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+    return (int)len;
+}
@@ -1,6 +1,8 @@
 #ifndef TIME_UTILS_H_INCLUDED
 #define TIME_UTILS_H_INCLUDED
 
+#include <stdint.h>
+
 void fprint_mm_ss(FILE* file, time_t time);
 
 void fprint_hh_mm_ss(FILE* file, time_t time);
@@ -9,4 +11,25 @@ void fprint_time_date_short(FILE* file, time_t time);
 
 void fprint_time_nodate(FILE* file, time_t time);
 
+//same as fprint_time_nodate, into buf. Thread safe. Returns number of chars written
+int sprint_time_nodate(char* buf, size_t size, time_t time);
+
+//milliseconds from unspecified point, never goes back
+uint64_t monotonicTimeMs();
+
+//nanoseconds, same clock as monotonicTimeMs
+uint64_t monotonicTimeNs();
+
+//Timestamps for logs: wall clock is read and formatted once per second per thread,
+//sub-second part comes from the monotonic clock. No locks, every thread has its own cache
+
+//"[hh:mm:ss.uuuuuu]"
+static const size_t TIMESTAMP_LEN = 17;
+
+//nanoseconds since epoch
+int64_t wallTimeNs();
+
+//current time as "[hh:mm:ss.uuuuuu]" into buf. Returns number of chars written
+int sprint_timestamp(char* buf, size_t size);
+
 #endif // TIME_UTILS_H_INCLUDED